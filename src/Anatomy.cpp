@@ -0,0 +1,116 @@
+#include "Anatomy.hpp"
+#include <cstdio>
+
+Anatomy::Anatomy(void)
+{
+    m_hasDistanceField = false;
+}
+
+Anatomy::~Anatomy(void)
+{
+}
+
+bool Anatomy::LoadFromFile(const char fname[])
+{
+    //the obstacles may still point into a previously mapped file
+    m_obstacles.Clear();
+    m_grid.Build(m_obstacles);
+    m_mapping.Close();
+    m_hasDistanceField = false;
+    m_nearestWall.Clear();
+    m_fileName = fname;
+    
+    if(IsBinaryObstacleFile(fname))
+	return LoadFromBinaryFile(fname);
+    return LoadFromTextFile(fname);
+}
+
+bool Anatomy::LoadFromBinaryFile(const char fname[])
+{
+    bool hasGrid = false;
+    
+    if(!m_mapping.Open(fname))
+    {
+	printf("error: cannot open obstacle file %s\n", fname);
+	return false;
+    }
+    
+    if(!ViewBinaryObstacleFile(m_mapping, m_obstacles, m_grid, hasGrid))
+    {
+	m_obstacles.Clear();
+	m_mapping.Close();
+	BuildIndex();
+	return false;
+    }
+    
+    if(!hasGrid)
+	BuildIndex();
+    
+    return true;
+}
+
+bool Anatomy::LoadFromTextFile(const char fname[])
+{
+    bool ok = true;
+    
+    //file with obstacles (x y r)
+    FILE *in = fopen(fname, "r");
+    if(in)
+    {
+	int nrObstacles;
+	double x; double y; double r;
+	
+	if(fscanf(in, "%d", &nrObstacles) != 1)
+	{
+	    printf("error: expecting number of obstacles\n");
+	    nrObstacles = 0;
+	    ok = false;
+	}
+	m_obstacles.Reserve(nrObstacles);
+	
+	for(int i=0; i<nrObstacles; i++)
+	{
+	    if(fscanf(in, "%lf %lf %lf", &x, &y, &r) != 3)
+	    {
+		printf("invalid obstacle definition, expecting x y r\n");
+		ok = false;
+		break;
+	    }
+	    m_obstacles.AddObstacle(x, y, r);
+	}
+	fclose(in);
+    }
+    else
+    {
+	printf("error: cannot open obstacle file %s\n", fname);
+	ok = false;
+    }
+    
+    BuildIndex();
+    
+    return ok;
+}
+
+bool Anatomy::SaveBinary(const char fname[], const bool withIndex) const
+{
+    return WriteBinaryObstacleFile(fname, m_obstacles, withIndex ? &m_grid : NULL);
+}
+
+void Anatomy::BuildDistanceField(const DistanceFieldParameters &params)
+{
+    m_distanceField.Build(m_obstacles, m_grid, params);
+    m_hasDistanceField = true;
+}
+
+bool Anatomy::LoadNearestWallTable(const NearestWallParameters &params)
+{
+    if(m_fileName.empty())
+	return false;
+    return m_nearestWall.LoadOrBuild(m_fileName.c_str(), m_obstacles, m_grid, params);
+}
+
+void Anatomy::BuildIndex(void)
+{
+    //obstacles never move, so bucket them once for the per-tick radius queries
+    m_grid.Build(m_obstacles);
+}
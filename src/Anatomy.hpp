@@ -0,0 +1,126 @@
+/**
+ *@file Anatomy.hpp
+ *@brief Cochlea wall obstacles together with their spatial index. An anatomy
+ *       never changes once loaded, so it can be shared (read-only) by any
+ *       number of simulators, e.g. the workers of a parameter sweep.
+ */
+
+#ifndef ANATOMY_HPP_
+#define ANATOMY_HPP_
+
+#include <cstddef>
+#include <string>
+#include "DistanceField.hpp"
+#include "NearestWallTable.hpp"
+#include "ObstacleFile.hpp"
+#include "ObstacleGrid.hpp"
+#include "ObstacleSet.hpp"
+
+class Anatomy
+{
+public:
+    Anatomy(void);
+    
+    ~Anatomy(void);
+
+    /**
+     *@brief Reads circular obstacles from an obstacle file and builds the spatial index.
+     *       Binary obstacle files (see ObstacleFile.hpp) are detected automatically and
+     *       memory-mapped instead of parsed; their precomputed grid is used if present.
+     *
+     *@param fname name of file with obstacle information
+     *@return false if the file could not be opened or was malformed
+     *        (obstacles read up to the error are kept)
+     */
+    bool LoadFromFile(const char fname[]);
+
+    /**
+     *@brief Writes the obstacles (and, if withIndex, the spatial index) as a binary obstacle file
+     */
+    bool SaveBinary(const char fname[], const bool withIndex) const;
+
+    /**
+     *@brief Rebuilds the spatial index; call after adding obstacles by hand
+     */
+    void BuildIndex(void);
+
+    int GetNrObstacles(void) const
+    {
+	return m_obstacles.GetNrObstacles();
+    }
+
+    const ObstacleSet& GetObstacles(void) const
+    {
+	return m_obstacles;
+    }
+
+    ObstacleSet& GetObstacles(void)
+    {
+	return m_obstacles;
+    }
+
+    const ObstacleGrid& GetGrid(void) const
+    {
+	return m_grid;
+    }
+
+    /**
+     *@brief Rasterizes the walls into a signed distance field (for the planner's
+     *       distance-field mode); call after the obstacles are loaded
+     */
+    void BuildDistanceField(const DistanceFieldParameters &params);
+
+    /**
+     *@brief Returns the distance field, or NULL if it has not been built
+     */
+    const DistanceField* GetDistanceField(void) const
+    {
+	return m_hasDistanceField ? &m_distanceField : NULL;
+    }
+
+    /**
+     *@brief Maps the nearest-wall table of this anatomy from the on-disk cache, building
+     *       and caching it on first use (see NearestWallTable.hpp). Requires the
+     *       anatomy to have been read with LoadFromFile.
+     */
+    bool LoadNearestWallTable(const NearestWallParameters &params);
+
+    /**
+     *@brief Drops the nearest-wall table; call after moving obstacles by hand
+     */
+    void ClearNearestWallTable(void)
+    {
+	m_nearestWall.Clear();
+    }
+
+    /**
+     *@brief Returns the nearest-wall table, or NULL if it has not been loaded
+     */
+    const NearestWallTable* GetNearestWallTable(void) const
+    {
+	return m_nearestWall.IsEmpty() ? NULL : &m_nearestWall;
+    }
+
+protected:
+    bool LoadFromTextFile(const char fname[]);
+    bool LoadFromBinaryFile(const char fname[]);
+
+    ObstacleSet  m_obstacles;
+    ObstacleGrid m_grid;
+
+    DistanceField m_distanceField;
+    bool          m_hasDistanceField;
+
+    //file the obstacles were read from (keys the nearest-wall cache)
+    std::string      m_fileName;
+    NearestWallTable m_nearestWall;
+
+    //backing storage when loaded from a binary file
+    MappedFile   m_mapping;
+
+private:
+    Anatomy(const Anatomy &);
+    Anatomy& operator=(const Anatomy &);
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "AnatomyGenerator.hpp"
+
+SpiralParameters::SpiralParameters(void)
+{
+    scale      = 9.43;
+    growth     = 2.618;
+    offset     = 4.1;
+    angleStep  = M_PI / 180;
+    thetaStart = -0.3;
+    thetaEnd   = 4 * M_PI;
+    wallRadius = 0.1;
+    centerX    = 5;
+    centerY    = -1;
+}
+
+long GetNrSpiralPoints(const SpiralParameters &params)
+{
+    if(params.angleStep <= 0 || params.thetaEnd < params.thetaStart)
+	return 0;
+    
+    //same as the number of elements of thetaStart:angleStep:thetaEnd in MATLAB
+    return 1 + (long) floor((params.thetaEnd - params.thetaStart) / params.angleStep + 1e-10);
+}
+
+//calls sink(x, y, r) for every wall sample
+template <typename Sink>
+static void ForEachSpiralPoint(const SpiralParameters &params, Sink &sink)
+{
+    const long   n = GetNrSpiralPoints(params);
+    const double a = params.scale * params.growth;
+    
+    for(long k = 0; k < n; ++k)
+    {
+	const double theta = params.thetaStart + k * params.angleStep;
+	const double r     = a / (theta + params.offset);
+	
+	sink(params.centerX + r * cos(M_PI / 2 - theta),
+	     params.centerY + r * sin(M_PI / 2 - theta),
+	     params.wallRadius);
+    }
+}
+
+struct ObstacleSetSink
+{
+    ObstacleSet *obstacles;
+    
+    void operator()(const double x, const double y, const double r)
+    {
+	obstacles->AddObstacle(x, y, r);
+    }
+};
+
+struct FileSink
+{
+    FILE *out;
+    
+    void operator()(const double x, const double y, const double r)
+    {
+	fprintf(out, "%f %f %g\n", x, y, r);
+    }
+};
+
+void GenerateSpiralWall(const SpiralParameters &params, ObstacleSet &obstacles)
+{
+    ObstacleSetSink sink;
+    sink.obstacles = &obstacles;
+    
+    obstacles.Reserve(obstacles.GetNrObstacles() + GetNrSpiralPoints(params));
+    ForEachSpiralPoint(params, sink);
+}
+
+void GenerateSpiralAnatomy(const SpiralParameters &params, Anatomy &anatomy)
+{
+    anatomy.GetObstacles().Clear();
+    GenerateSpiralWall(params, anatomy.GetObstacles());
+    anatomy.BuildIndex();
+}
+
+bool WriteSpiralWall(const SpiralParameters &params, FILE *out)
+{
+    FileSink sink;
+    sink.out = out;
+    
+    fprintf(out, "%ld\n", GetNrSpiralPoints(params));
+    ForEachSpiralPoint(params, sink);
+    
+    return !ferror(out);
+}
@@ -0,0 +1,62 @@
+/**
+ *@file AnatomyGenerator.hpp
+ *@brief Synthetic cochlea walls: the Archimedean-style spiral of
+ *       utils/make_obstacles.m, with its constants as parameters
+ */
+
+#ifndef ANATOMY_GENERATOR_HPP_
+#define ANATOMY_GENERATOR_HPP_
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdio>
+#include "Anatomy.hpp"
+
+/**
+ * The wall is sampled at theta = thetaStart, thetaStart + angleStep, ... <= thetaEnd
+ * with one circle of radius wallRadius per sample at
+ *
+ *   r = scale * growth / (theta + offset)
+ *   [centerX + r * cos(pi/2 - theta), centerY + r * sin(pi/2 - theta)]
+ *
+ * The defaults reproduce bin/cochlea_male_A943.txt; the other anatomies in bin/
+ * use scale = A / 100 (e.g. 8.25 for cochlea_small_A825.txt).
+ */
+struct SpiralParameters
+{
+    SpiralParameters(void);
+    
+    double scale;
+    double growth;
+    double offset;
+    double angleStep;
+    double thetaStart;
+    double thetaEnd;
+    double wallRadius;
+    double centerX;
+    double centerY;
+};
+
+/**
+ *@brief Number of wall samples generated for the given parameters
+ */
+long GetNrSpiralPoints(const SpiralParameters &params);
+
+/**
+ *@brief Appends the spiral wall obstacles to an obstacle set
+ */
+void GenerateSpiralWall(const SpiralParameters &params, ObstacleSet &obstacles);
+
+/**
+ *@brief Replaces the obstacles of an anatomy with the spiral wall and builds its index,
+ *       ready to be shared by simulators
+ */
+void GenerateSpiralAnatomy(const SpiralParameters &params, Anatomy &anatomy);
+
+/**
+ *@brief Writes the spiral wall as an obstacle text file (count, then x y r per line),
+ *       streaming the samples without storing them
+ */
+bool WriteSpiralWall(const SpiralParameters &params, FILE *out);
+
+#endif
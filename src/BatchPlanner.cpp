@@ -0,0 +1,226 @@
+/**
+ *@file BatchPlanner.cpp
+ *@brief Runs a single insertion headless (no GLUT window, no timer) and
+ *       reports ticks, damage and CPU time
+ */
+
+#include "InsertionRunner.hpp"
+#include "RRTConnectPlanner.hpp"
+#include <cstring>
+#include <new>
+
+//heap allocation counter for --count-allocs (the whole program goes through it)
+static long g_nrAllocations = 0;
+
+void* operator new(std::size_t size)
+{
+    g_nrAllocations++;
+    void *ptr = malloc(size ? size : 1);
+    if(ptr == NULL)
+	throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) throw()
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) throw()
+{
+    free(ptr);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 4)
+    {
+	printf("missing arguments\n");		
+	printf("  BatchPlanner <obstacle file> <nrLinks> <linkLength> [maxTicks] [--count-allocs]\n");
+	printf("               [--distance-field <resolution>] [--nearest-table <resolution>]\n");
+	printf("               [--link-collision] [--swept-collision] [--damage-log <file>]\n");
+	printf("               [--adaptive-step] [--swept-step] [--step-log <file>]\n");
+	printf("               [--threads <n>] [--rrt] [--rrt-seed <n>] [--record <file>]\n");
+	printf("               [--profile <file>] [--profile-every <ticks>] [--profile-json]\n");
+	return 0;		
+    }
+
+    int  maxTicks    = 0;
+    bool countAllocs = false;
+    PlannerParameters       params;
+    DistanceFieldParameters fieldParams;
+    NearestWallParameters   tableParams;
+    bool                    useTable = false;
+    FILE                   *damageLog = NULL;
+    FILE                   *stepLog   = NULL;
+    int                     nrThreads = 1;
+    bool                    useRRT    = false;
+    RRTParameters           rrtParams;
+    const char             *recordFile = NULL;
+    FILE                   *profileLog   = NULL;
+    int                     profileEvery = 0;
+    bool                    profileJSON  = false;
+    for(int i = 4; i < argc; ++i)
+    {
+	if(strcmp(argv[i], "--count-allocs") == 0)
+	    countAllocs = true;
+	else if(strcmp(argv[i], "--distance-field") == 0 && i + 1 < argc)
+	{
+	    params.useDistanceField = true;
+	    fieldParams.resolution  = atof(argv[++i]);
+	}
+	else if(strcmp(argv[i], "--link-collision") == 0)
+	    params.linkCollision = true;
+	else if(strcmp(argv[i], "--swept-collision") == 0)
+	    params.sweptCollision = true;
+	else if(strcmp(argv[i], "--damage-log") == 0 && i + 1 < argc)
+	{
+	    damageLog = fopen(argv[++i], "w");
+	    if(damageLog == NULL)
+	    {
+		printf("error: cannot write damage log %s\n", argv[i]);
+		return 1;
+	    }
+	    fprintf(damageLog, "tick,cell\n");
+	}
+	else if(strcmp(argv[i], "--adaptive-step") == 0)
+	    params.adaptiveStep = true;
+	else if(strcmp(argv[i], "--swept-step") == 0)
+	    params.sweptStep = true;
+	else if(strcmp(argv[i], "--step-log") == 0 && i + 1 < argc)
+	{
+	    stepLog = fopen(argv[++i], "w");
+	    if(stepLog == NULL)
+	    {
+		printf("error: cannot write step log %s\n", argv[i]);
+		return 1;
+	    }
+	    fprintf(stepLog, "tick,stage,stepSize,clearance\n");
+	}
+	else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+	    nrThreads = atoi(argv[++i]);
+	else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+	    recordFile = argv[++i];
+	else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+	{
+	    profileLog = fopen(argv[++i], "w");
+	    if(profileLog == NULL)
+	    {
+		printf("error: cannot write profile %s\n", argv[i]);
+		return 1;
+	    }
+	}
+	else if(strcmp(argv[i], "--profile-every") == 0 && i + 1 < argc)
+	    profileEvery = atoi(argv[++i]);
+	else if(strcmp(argv[i], "--profile-json") == 0)
+	    profileJSON = true;
+	else if(strcmp(argv[i], "--rrt") == 0)
+	    useRRT = true;
+	else if(strcmp(argv[i], "--rrt-seed") == 0 && i + 1 < argc)
+	{
+	    useRRT         = true;
+	    rrtParams.seed = atoi(argv[++i]);
+	}
+	else if(strcmp(argv[i], "--nearest-table") == 0 && i + 1 < argc)
+	{
+	    useTable               = true;
+	    tableParams.resolution = atof(argv[++i]);
+	}
+	else
+	    maxTicks = atoi(argv[i]);
+    }
+
+    Anatomy anatomy;
+    anatomy.LoadFromFile(argv[1]);
+    if(params.useDistanceField)
+	anatomy.BuildDistanceField(fieldParams);
+    if(useTable)
+	anatomy.LoadNearestWallTable(tableParams);
+
+    ManipSimulator simulator(&anatomy);
+    ManipPlanner   planner(&simulator, params);
+    
+    simulator.SetupLinks(atoi(argv[2]), atof(argv[3]));
+    
+    //the workers are started here, before any tick is counted
+    ThreadPool *pool = NULL;
+    if(nrThreads != 1)
+    {
+	pool = new ThreadPool(nrThreads);
+	planner.SetThreadPool(pool);
+    }
+    
+    //the whole insertion is planned before the first tick, then replayed
+    InsertionTrajectory trajectory;
+    if(useRRT)
+    {
+	RRTConnectPlanner rrt(&simulator, rrtParams);
+	const bool found = rrt.Plan(trajectory, pool);
+	const RRTStatistics &stats = rrt.GetStatistics();
+	printf("RRT PLANNING TIME: %.6f s\n", stats.seconds);
+	printf("RRT NODES: %ld in %ld iterations\n", stats.nodes, stats.iterations);
+	printf("RRT WAYPOINTS: %d (%d moves)\n", stats.nrWaypoints, (int) trajectory.moves.size());
+	if(!found)
+	{
+	    printf("error: no collision-free insertion found\n");
+	    delete pool;
+	    return 1;
+	}
+	planner.SetTrajectory(&trajectory);
+    }
+    
+    //the phase histograms, every profileEvery ticks and once at the end
+    if(profileLog && planner.GetProfiler() == NULL)
+	printf("warning: --profile needs a build with -DCOCHLEAMP_ENABLE_PROFILING=ON\n");
+    else if(profileLog)
+	planner.GetProfiler()->SetPeriodicDump(profileLog, profileEvery, profileJSON);
+    
+    TrajectoryWriter trajectoryLog;
+    if(recordFile && !trajectoryLog.Open(recordFile, simulator))
+    {
+	delete pool;
+	return 1;
+    }
+    
+    InsertionResult result;
+    if(countAllocs)
+    {
+	//the first ticks size the planner workspaces; after that a tick
+	//should not allocate at all
+	const int warmupTicks = 10;
+	InsertionResult warmup = RunInsertion(&planner, &simulator, warmupTicks, damageLog, stepLog, &trajectoryLog);
+	
+	const long before = g_nrAllocations;
+	result = RunInsertion(&planner, &simulator, maxTicks > 0 ? maxTicks - warmup.ticks : 0, damageLog, stepLog, &trajectoryLog);
+	const long allocs = g_nrAllocations - before;
+	
+	result.ticks      += warmup.ticks;
+	result.cpuSeconds += warmup.cpuSeconds;
+	result.wallSeconds += warmup.wallSeconds;
+	printf("HEAP ALLOCATIONS AFTER WARMUP: %ld in %d ticks\n", allocs, result.ticks - warmup.ticks);
+    }
+    else
+	result = RunInsertion(&planner, &simulator, maxTicks, damageLog, stepLog, &trajectoryLog);
+    
+    if(damageLog)
+	fclose(damageLog);
+    if(stepLog)
+	fclose(stepLog);
+    if(profileLog)
+    {
+	if(planner.GetProfiler())
+	    planner.GetProfiler()->Dump();
+	fclose(profileLog);
+    }
+    trajectoryLog.Close();
+    delete pool;
+    
+    printf("TICKS: %d\n", result.ticks);
+    printf("TOTAL CELLS DAMAGED: %d\n", result.totalCellsDamaged);
+    printf("PERCENT OF CELLS DAMAGED: %.2f%%\n", result.percentDamaged);
+    printf("CPU TIME: %.6f s\n", result.cpuSeconds);
+    if(!result.completed)
+	printf("warning: insertion did not complete within %d ticks\n", maxTicks);
+    
+    return result.completed ? 0 : 1;
+}
@@ -0,0 +1,716 @@
+#include "BatchSimulator.hpp"
+#include <algorithm>
+
+//instances per block; a block is the unit of work handed to the thread pool
+static const int BLOCK_SIZE = 64;
+
+BatchSimulator::BatchSimulator(const int nrLinks, const double linkLength)
+{
+    m_nrLinks     = nrLinks;
+    m_linkLength  = linkLength;
+    m_nrInstances = 0;
+    m_stride      = 0;
+
+    //an electrode set up the usual way gives the start configuration,
+    //joint limits and goal, so both simulators agree on them
+    ManipSimulator reference((const Anatomy *) NULL);
+    reference.SetupLinks(nrLinks, linkLength);
+
+    m_startX = reference.GetLinkStartX(0);
+    m_startY = reference.GetLinkStartY(0);
+    m_thetaLimits.resize(nrLinks);
+    for(int i = 0; i < nrLinks; ++i)
+	m_thetaLimits[i] = reference.GetLinkThetaLimit(i);
+    m_goalX      = reference.GetGoalCenterX();
+    m_goalY      = reference.GetGoalCenterY();
+    m_goalRadius = reference.GetGoalRadius();
+
+    //summed as ManipPlanner::GetElectrodeLength does
+    m_electrodeLength = 0;
+    for(int i = 0; i < nrLinks; ++i)
+	m_electrodeLength += reference.GetLinkLength(i);
+    m_lengths = reference.GetLinkLengths();
+}
+
+BatchSimulator::~BatchSimulator(void)
+{
+}
+
+void BatchSimulator::Reserve(const int n)
+{
+    if(n <= m_stride)
+	return;
+
+    //grow geometrically and move every link row to the new stride
+    const int stride = std::max(n, 2 * m_stride);
+    std::vector<double>* arrays[] = {&m_joints, &m_absAngles, &m_chainX, &m_chainY, &m_posX, &m_posY};
+    const int            rows[]   = {m_nrLinks, m_nrLinks, m_nrLinks + 1, m_nrLinks + 1, m_nrLinks + 1, m_nrLinks + 1};
+
+    for(int a = 0; a < 6; ++a)
+    {
+	std::vector<double> grown((size_t) rows[a] * stride, 0.0);
+	for(int i = 0; i < rows[a]; ++i)
+	    std::copy(arrays[a]->begin() + (size_t) i * m_stride,
+		      arrays[a]->begin() + (size_t) i * m_stride + m_nrInstances,
+		      grown.begin() + (size_t) i * stride);
+	arrays[a]->swap(grown);
+    }
+    m_stride = stride;
+}
+
+int BatchSimulator::AddInstance(const Anatomy * const anatomy, const PlannerParameters &params)
+{
+    const int b = m_nrInstances;
+    Reserve(b + 1);
+    m_nrInstances++;
+
+    //straight electrode at the start (the chain is filled in by FK)
+    for(int i = 0; i < m_nrLinks; ++i)
+	m_joints[i * m_stride + b] = 0;
+    m_chainX[b] = 0;
+    m_chainY[b] = 0;
+    m_baseX.push_back(m_startX);
+    m_baseY.push_back(m_startY);
+
+    //same initial planner state as the ManipPlanner constructor
+    m_stage.push_back(0);
+    m_retraction.push_back(0);
+    m_sensedFront.push_back(0);
+    m_alpha.push_back(params.alpha);
+    m_gamma.push_back(params.gamma);
+    m_Q.push_back(params.Q);
+    m_beta.push_back(params.beta);
+    m_betaFactor.push_back(params.localMinimumBetaFactor);
+    m_alphaFactor.push_back(params.localMinimumAlphaFactor);
+    m_maxOCTDepth.push_back(params.maxOCTDepth);
+    m_angleBandwidth.push_back(params.angleBandwidth);
+    m_useDistanceField.push_back(params.useDistanceField);
+    m_linkCollision.push_back(params.linkCollision);
+    m_sweptCollision.push_back(params.sweptCollision);
+    m_adaptiveStep.push_back(params.adaptiveStep);
+    m_stepSafety.push_back(params.stepSafety);
+    m_minStepScale.push_back(params.minStepScale);
+    m_maxStepScale.push_back(params.maxStepScale);
+    m_sweptStep.push_back(params.sweptStep);
+    m_stepSize.push_back(0);
+    m_clearance.push_back(HUGE_VAL);
+    m_deltaTheta.push_back(0);
+    m_deltaX.push_back(0);
+    m_deltaY.push_back(0);
+    m_ticks.push_back(0);
+    m_active.push_back(1);
+
+    const int O = anatomy->GetNrObstacles();
+    m_lanes.push_back(Lane());
+    Lane &lane = m_lanes.back();
+    lane.anatomy = anatomy;
+    lane.sensed.assign(O, 0);
+    lane.damage.Reset(O);
+
+    FK(b, b + 1);
+    m_active[b] = !HasReachedGoal(b);
+
+    return b;
+}
+
+int BatchSimulator::Step(const int maxTicks, ThreadPool *pool)
+{
+    const int nrBlocks = (m_nrInstances + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if((int) m_scratch.size() < nrBlocks)
+	m_scratch.resize(nrBlocks);
+
+    if(pool && nrBlocks > 1)
+	pool->ParallelFor(nrBlocks, [&](int k)
+	{
+	    StepBlock(k * BLOCK_SIZE, std::min(m_nrInstances, (k + 1) * BLOCK_SIZE), maxTicks, m_scratch[k]);
+	});
+    else
+	for(int k = 0; k < nrBlocks; ++k)
+	    StepBlock(k * BLOCK_SIZE, std::min(m_nrInstances, (k + 1) * BLOCK_SIZE), maxTicks, m_scratch[k]);
+
+    int nrActive = 0;
+    for(int b = 0; b < m_nrInstances; ++b)
+	nrActive += m_active[b];
+    return nrActive;
+}
+
+void BatchSimulator::Run(const int maxTicks, ThreadPool *pool)
+{
+    while(Step(maxTicks, pool) > 0)
+	;
+}
+
+InsertionResult BatchSimulator::GetResult(const int b) const
+{
+    InsertionResult result;
+
+    result.ticks             = m_ticks[b];
+    result.totalCellsDamaged = m_lanes[b].damage.GetNrDamaged();
+    result.nrObstacles       = m_lanes[b].anatomy->GetNrObstacles();
+    result.percentDamaged    = result.nrObstacles > 0 ? 100.0 * result.totalCellsDamaged / result.nrObstacles : 0;
+    result.cpuSeconds        = 0;
+    result.wallSeconds       = 0;
+    result.completed         = m_retraction[b] == -1 || HasReachedGoal(b);
+
+    return result;
+}
+
+void BatchSimulator::StepBlock(const int begin, const int end, const int maxTicks, Scratch &scratch)
+{
+    //same checks as the RunInsertion loop, so a smaller maxTicks takes effect at once
+    UpdateActive(begin, end, maxTicks);
+
+    for(int b = begin; b < end; ++b)
+	m_lanes[b].damage.BeginTick();
+
+    //the phases of ConfigurationMove, then those of ApplyMove
+    ScanOCT(begin, end, scratch);
+    CollisionChecker(begin, end, scratch);
+    UpdateRetraction(begin, end);
+    ComputeMoves(begin, end, scratch);
+    ApplyMoves(begin, end);
+    FK(begin, end);
+
+    for(int b = begin; b < end; ++b)
+	m_ticks[b] += m_active[b];
+
+    UpdateActive(begin, end, maxTicks);
+}
+
+void BatchSimulator::UpdateActive(const int begin, const int end, const int maxTicks)
+{
+    for(int b = begin; b < end; ++b)
+	if(m_active[b] && (m_retraction[b] == -1 || HasReachedGoal(b) || (maxTicks > 0 && m_ticks[b] >= maxTicks)))
+	    m_active[b] = 0;
+}
+
+bool BatchSimulator::HasReachedGoal(const int b) const
+{
+    const double ex = m_posX[m_nrLinks * m_stride + b];
+    const double ey = m_posY[m_nrLinks * m_stride + b];
+
+    return sqrt((ex - m_goalX) * (ex - m_goalX) + (ey - m_goalY) * (ey - m_goalY)) < m_goalRadius;
+}
+
+double BatchSimulator::GetTipAngle(const int b) const
+{
+    double angle = m_absAngles[(m_nrLinks - 1) * m_stride + b];
+    while(angle < 0)
+	angle += 2*M_PI;
+    return angle;
+}
+
+/**
+ * ManipPlanner::ScanOCT, keeping only what the planner uses: whether something
+ * was sensed in front of the tip and which obstacles were sensed for the first time.
+ */
+void BatchSimulator::ScanOCT(const int begin, const int end, Scratch &scratch)
+{
+    const int L = m_nrLinks;
+
+    for(int b = begin; b < end; ++b)
+    {
+	if(!m_active[b])
+	    continue;
+
+	Lane             &lane      = m_lanes[b];
+	const double      ex        = m_posX[L * m_stride + b];
+	const double      ey        = m_posY[L * m_stride + b];
+	const double      maxDepth  = m_maxOCTDepth[b];
+	const double      bandwidth = m_angleBandwidth[b];
+	const ObstacleSet &obstacles = lane.anatomy->GetObstacles();
+
+	lane.anatomy->GetGrid().GetObstaclesWithinDist(ex, ey, maxDepth, scratch.nearby);
+	const int NrNear = scratch.nearby.size();
+	scratch.closestX.resize(NrNear);
+	scratch.closestY.resize(NrNear);
+	scratch.centerDist.resize(NrNear);
+	if(NrNear > 0)
+	    obstacles.ClosestPointsAtMaxDist(ex, ey, maxDepth, &scratch.nearby[0], NrNear,
+					     &scratch.closestX[0], &scratch.closestY[0], &scratch.centerDist[0]);
+
+	const double tipAngle = GetTipAngle(b);
+	bool         front    = false;
+
+	for(int k = 0; k < NrNear; ++k)
+	{
+	    const double px = scratch.closestX[k];
+	    const double py = scratch.closestY[k];
+	    if(!(px < 0.5*HUGE_VAL && py < 0.5*HUGE_VAL))
+		continue;
+
+	    //ManipPlanner::GetAngleToPoint, relative to the last link
+	    double theta = atan2(py - ey, px - ex);
+	    if(theta < 0)
+		theta += 2*M_PI;
+	    const double phi = theta - tipAngle;
+
+	    if(fabs(phi) < bandwidth || fabs(phi-0.5*M_PI) < bandwidth || fabs(phi-1.5*M_PI) < bandwidth || fabs(phi+0.5*M_PI) < bandwidth)
+	    {
+		if(fabs(phi) < bandwidth)
+		    front = true;
+
+		const int i = scratch.nearby[k];
+		if(!lane.sensed[i])
+		{
+		    lane.sensed[i] = 1;
+		    lane.sensedX.push_back(obstacles.GetCenterX(i));
+		    lane.sensedY.push_back(obstacles.GetCenterY(i));
+		    lane.sensedR.push_back(obstacles.GetRadius(i));
+		}
+	    }
+	}
+	m_sensedFront[b] = front;
+    }
+}
+
+/**
+ * ManipPlanner::CollisionChecker: counts the wall cells that a joint or the tip
+ * comes within 0.1 of for the first time.
+ */
+void BatchSimulator::CollisionChecker(const int begin, const int end, Scratch &scratch)
+{
+    const int L = m_nrLinks;
+
+    for(int b = begin; b < end; ++b)
+    {
+	if(!m_active[b])
+	    continue;
+
+	Lane                   &lane        = m_lanes[b];
+	const ObstacleSet      &obstacles   = lane.anatomy->GetObstacles();
+	const NearestWallTable *nearestWall = lane.anatomy->GetNearestWallTable();
+	const double            reach       = 0.1 + lane.anatomy->GetGrid().GetMaxRadius();
+
+	//swept collision from the configuration at the last check
+	if(m_sweptCollision[b])
+	{
+	    GetConfiguration(b, scratch.to);
+	    if(lane.previous.joints.empty())
+		lane.previous = scratch.to;
+
+	    scratch.sweep.MarkContacts(m_lengths, lane.previous, scratch.to, obstacles, lane.anatomy->GetGrid(),
+				       CONTACT_DISTANCE, lane.damage);
+	    lane.previous = scratch.to;
+	    continue;
+	}
+
+	//ManipPlanner::LinkCollisionChecker
+	for(int j = 0; m_linkCollision[b] && j < L; ++j)
+	{
+	    const double ax = m_posX[j * m_stride + b];
+	    const double ay = m_posY[j * m_stride + b];
+	    const double bx = m_posX[(j + 1) * m_stride + b];
+	    const double by = m_posY[(j + 1) * m_stride + b];
+
+	    if(nearestWall)
+	    {
+		const double halfLength = 0.5 * sqrt((bx - ax) * (bx - ax) + (by - ay) * (by - ay));
+		if(nearestWall->GetDistanceLowerBound(0.5 * (ax + bx), 0.5 * (ay + by)) - halfLength > 0.1 + 1e-9)
+		    continue;
+	    }
+
+	    lane.anatomy->GetGrid().GetObstaclesNearSegment(ax, ay, bx, by, reach, scratch.nearby);
+	    for(int k = 0; k < (int) scratch.nearby.size(); ++k)
+	    {
+		const int i = scratch.nearby[k];
+		if(lane.damage.IsDamaged(i))
+		    continue;
+
+		const double d = sqrt(SquaredDistanceToSegment(ax, ay, bx, by, obstacles.GetCenterX(i), obstacles.GetCenterY(i)));
+		if(d - obstacles.GetRadius(i) < 0.1)
+		    lane.damage.MarkDamaged(i);
+	    }
+	}
+
+	for(int j = 0; !m_linkCollision[b] && j <= L; ++j)
+	{
+	    const double x = m_posX[j * m_stride + b];
+	    const double y = m_posY[j * m_stride + b];
+
+	    if(nearestWall && nearestWall->GetDistanceLowerBound(x, y) > 0.1 + 1e-9)
+		continue;
+
+	    lane.anatomy->GetGrid().GetObstaclesWithinDist(x, y, reach, scratch.nearby);
+	    for(int k = 0; k < (int) scratch.nearby.size(); ++k)
+	    {
+		const int i = scratch.nearby[k];
+		if(lane.damage.IsDamaged(i))
+		    continue;
+
+		//ManipSimulator::ClosestPointOnObstacle and ManipPlanner::DistanceBetweenPoints
+		const double cx = obstacles.GetCenterX(i);
+		const double cy = obstacles.GetCenterY(i);
+		const double r  = obstacles.GetRadius(i);
+		const double d  = sqrt((cx - x) * (cx - x) + (cy - y) * (cy - y));
+		const double ox = cx + r * (x - cx) / d;
+		const double oy = cy + r * (y - cy) / d;
+
+		if(sqrt(pow(x-ox,2) + pow(y-oy,2)) < 0.1)
+		    lane.damage.MarkDamaged(i);
+	    }
+	}
+    }
+}
+
+/**
+ * ManipSimulator::GetCurrentLink for every instance: the first joint that can
+ * still bend, or -1 if the electrode is fully bent.
+ */
+void BatchSimulator::UpdateRetraction(const int begin, const int end)
+{
+    for(int b = begin; b < end; ++b)
+	if(m_active[b])
+	    m_retraction[b] = -1;
+
+    //scanning the joints backwards leaves the first one that matches
+    for(int i = m_nrLinks - 1; i >= 0; --i)
+    {
+	const double  limit  = m_thetaLimits[i];
+	const double *joints = &m_joints[i * m_stride];
+	for(int b = begin; b < end; ++b)
+	    if(m_active[b] && joints[b] > limit)
+		m_retraction[b] = i;
+    }
+}
+
+Point BatchSimulator::RepulsiveForceAtLink(const int b, const int j) const
+{
+    const Lane  &lane  = m_lanes[b];
+    const double px    = m_posX[(j + 1) * m_stride + b];
+    const double py    = m_posY[(j + 1) * m_stride + b];
+    const double alpha = m_alpha[b];
+    const double gamma = m_gamma[b];
+    const double Q     = m_Q[b];
+
+    Point totalForce;
+    totalForce.m_x = 0;
+    totalForce.m_y = 0;
+
+    //ManipPlanner::RepulsiveForceFromDistanceField
+    const DistanceField *field = lane.anatomy->GetDistanceField();
+    if(m_useDistanceField[b] && field)
+    {
+	double gx, gy;
+	double d = field->Sample(px, py, gx, gy);
+	if(d > Q)
+	    return totalForce;
+	if(d < 1e-3)
+	    d = 1e-3;
+
+	const double forceScale = gamma * exp(-alpha * d) * (1/d + alpha);
+	totalForce.m_x = gx * forceScale;
+	totalForce.m_y = gy * forceScale;
+	return totalForce;
+    }
+
+    //ManipPlanner::RepulsiveCSFAtLink, obstacle by obstacle in the order they were sensed
+    int S = lane.sensedX.size();
+    const NearestWallTable *nearestWall = lane.anatomy->GetNearestWallTable();
+    if(nearestWall && nearestWall->GetDistanceLowerBound(px, py) > Q * (1 + 1e-9))
+	S = 0;
+
+    for(int n = 0; n < S; ++n)
+    {
+	const double cx = lane.sensedX[n];
+	const double cy = lane.sensedY[n];
+	const double r  = lane.sensedR[n];
+
+	const double dcx   = cx - px;
+	const double dcy   = cy - py;
+	const double reach = (Q + r) * (1 + 1e-9);
+	if(dcx * dcx + dcy * dcy > reach * reach)
+	    continue;
+
+	const double dc = sqrt((cx - px) * (cx - px) + (cy - py) * (cy - py));
+	const double ox = cx + r * (px - cx) / dc;
+	const double oy = cy + r * (py - cy) / dc;
+
+	//ManipPlanner::RepulsiveForceAtPointFromClosestPoint
+	const double d = sqrt(pow(ox-px,2) + pow(oy-py,2));
+	double fx = 0, fy = 0;
+	if(!(d > Q))
+	{
+	    const double forceScale = -gamma * exp(-alpha * d) * (1/pow(d,2) + alpha/d);
+	    fx = (px-ox) * forceScale;
+	    fy = (py-oy) * forceScale;
+	}
+	totalForce.m_x -= fx;
+	totalForce.m_y -= fy;
+    }
+
+    return totalForce;
+}
+
+void BatchSimulator::AddCSF(const int b, const int j, const Point f)
+{
+    const int    N  = m_nrLinks;
+    const double jx = m_posX[(j + 1) * m_stride + b];
+    const double jy = m_posY[(j + 1) * m_stride + b];
+    const double fx = f.m_x;
+    const double fy = f.m_y;
+
+    //row j of the Jacobian (ManipPlanner::BuildJacobian) times the force; every
+    //term, zero columns included, is evaluated as in WSF2CSF so the sums match
+    //ConfigurationMove bit for bit
+    m_deltaX[b] += 1*fx + 0*fy;
+    m_deltaY[b] += 0*fx + 1*fy;
+    for(int i = 2; i < N+2; ++i)
+    {
+	const double px      = m_posX[(i - 2) * m_stride + b];
+	const double py      = m_posY[(i - 2) * m_stride + b];
+	const bool   canBend = m_retraction[b] == N - (i - 2) - 1;
+	const double jacX    = (-1*jy+py) * canBend;
+	const double jacY    = (jx-px) * canBend;
+
+	m_deltaTheta[b] += jacX*fx + jacY*fy;
+    }
+}
+
+/**
+ * The stage machine of ManipPlanner::ConfigurationMove (without its console output).
+ */
+void BatchSimulator::ComputeMoves(const int begin, const int end, Scratch &scratch)
+{
+    const int L = m_nrLinks;
+
+    for(int b = begin; b < end; ++b)
+    {
+	if(!m_active[b])
+	    continue;
+
+	double &deltaTheta = m_deltaTheta[b];
+	double &baseDeltaX = m_deltaX[b];
+	double &baseDeltaY = m_deltaY[b];
+
+	//ManipPlanner::SensedClearance and the step scales of adaptive stepping
+	double creepScale = 1, moveScale = 1;
+	if(m_adaptiveStep[b])
+	{
+	    const Lane &lane = m_lanes[b];
+	    const int   S    = lane.sensedX.size();
+	    double clearance = HUGE_VAL;
+	    for(int j = 0; j < L && S > 0; ++j)
+		clearance = SegmentClearance(m_posX[j * m_stride + b], m_posY[j * m_stride + b],
+					     m_posX[(j + 1) * m_stride + b], m_posY[(j + 1) * m_stride + b],
+					     &lane.sensedX[0], &lane.sensedY[0], &lane.sensedR[0], S, clearance);
+	    m_clearance[b] = clearance;
+	    creepScale = AdaptiveStepScale(clearance, StepReach(CREEP_STEP, 0, 0, m_electrodeLength), m_stepSafety[b], m_minStepScale[b], m_maxStepScale[b]);
+	    moveScale  = AdaptiveStepScale(clearance, StepReach(BASE_STEP, BASE_STEP, THETA_STEP, m_electrodeLength), m_stepSafety[b], m_minStepScale[b], m_maxStepScale[b]);
+	}
+	if(m_sweptStep[b] && !m_adaptiveStep[b])
+	{
+	    creepScale = m_maxStepScale[b];
+	    moveScale  = m_maxStepScale[b];
+	}
+
+	switch(m_stage[b])
+	{
+	    case 0:
+	    {
+		deltaTheta = 0;
+		baseDeltaY = 0;
+		if(m_sensedFront[b])
+		{
+		    m_stage[b] = 1;
+		    baseDeltaX = 0;
+		}
+		else
+		    baseDeltaX = CREEP_STEP * creepScale;
+		break;
+	    }
+
+	    case 1:
+	    {
+		baseDeltaX = 0;
+		baseDeltaY = 0;
+		deltaTheta = 0;
+
+		for(int i = 0; i < L; ++i)
+		    AddCSF(b, i, RepulsiveForceAtLink(b, i));
+
+		//ManipPlanner::AttractiveForce
+		const double theta = GetTipAngle(b);
+		Point v;
+		v.m_x = m_beta[b] * cos(theta);
+		v.m_y = m_beta[b] * sin(theta);
+		AddCSF(b, L-1, v);
+
+		while(fabs(baseDeltaX) > BASE_STEP * moveScale)
+		{
+		    baseDeltaX /= 2;
+		    baseDeltaY /= 2;
+		}
+		while(fabs(baseDeltaY) > BASE_STEP * moveScale)
+		{
+		    baseDeltaX /= 2;
+		    baseDeltaY /= 2;
+		}
+		while(fabs(deltaTheta) > THETA_STEP * moveScale)
+		    deltaTheta /= 2;
+
+		if(baseDeltaX == 0 && baseDeltaY == 0 && deltaTheta == 0)
+		    m_stage[b] = 0;
+		break;
+	    }
+
+	    case 2:
+	    {
+		m_beta[b]  *= m_betaFactor[b];
+		m_alpha[b] *= m_alphaFactor[b];
+		m_stage[b]  = 1;
+		break;
+	    }
+
+	    default:
+	    {
+		deltaTheta = m_thetaLimits[0] / 75;
+		baseDeltaX = 0.015;
+		break;
+	    }
+	}
+
+	if(m_sweptStep[b])
+	    ClipMoveAtFirstContact(b, scratch);
+
+	m_stepSize[b] = StepReach(baseDeltaX, baseDeltaY, deltaTheta, m_electrodeLength);
+    }
+}
+
+void BatchSimulator::GetConfiguration(const int b, ElectrodeConfiguration &config) const
+{
+    config.baseX = m_baseX[b];
+    config.baseY = m_baseY[b];
+    config.joints.resize(m_nrLinks);
+    for(int i = 0; i < m_nrLinks; ++i)
+	config.joints[i] = m_joints[i * m_stride + b];
+}
+
+void BatchSimulator::ClipMoveAtFirstContact(const int b, Scratch &scratch)
+{
+    const Lane &lane = m_lanes[b];
+    const int   S    = lane.sensedX.size();
+    if(S == 0 || (m_deltaTheta[b] == 0 && m_deltaX[b] == 0 && m_deltaY[b] == 0))
+	return;
+
+    //ManipSimulator::GetConfigurationAfterMove
+    ElectrodeConfiguration &from = scratch.from;
+    ElectrodeConfiguration &to   = scratch.to;
+    GetConfiguration(b, from);
+    to        = from;
+    to.baseX += m_deltaX[b];
+    to.baseY += m_deltaY[b];
+    ManipSimulator::SpreadBend(m_deltaTheta[b], &to.joints[0], &m_thetaLimits[0], m_nrLinks);
+
+    scratch.sweep.SetWalls(&lane.sensedX[0], &lane.sensedY[0], &lane.sensedR[0], S);
+    const double t = scratch.sweep.TimeOfFirstContact(m_lengths, from, to, CONTACT_DISTANCE);
+    if(t < 1)
+    {
+	const double s = std::max(m_stepSafety[b] * t, m_minStepScale[b] / m_maxStepScale[b]);
+	m_deltaTheta[b] *= s;
+	m_deltaX[b]     *= s;
+	m_deltaY[b]     *= s;
+    }
+}
+
+/**
+ * ManipSimulator::ApplyMove without the FK: moves the base and spreads the
+ * bend over the joints (ManipSimulator::AddToLinkTheta).
+ */
+void BatchSimulator::ApplyMoves(const int begin, const int end)
+{
+    const int L = m_nrLinks;
+
+    for(int b = begin; b < end; ++b)
+    {
+	if(!m_active[b])
+	    continue;
+
+	m_baseX[b] += m_deltaX[b];
+	m_baseY[b] += m_deltaY[b];
+
+	double dtheta = -m_deltaTheta[b];
+	if(dtheta > 0)
+	{
+	    for(int i = L - 1; i > -1; i--)
+	    {
+		double &joint = m_joints[i * m_stride + b];
+		if(joint - dtheta < m_thetaLimits[i])
+		{
+		    dtheta -= m_thetaLimits[i] - joint;
+		    joint = m_thetaLimits[i];
+		}
+		else
+		{
+		    joint -= dtheta;
+		    break;
+		}
+	    }
+	}
+	else if(dtheta < 0)
+	{
+	    for(int i = 0; i < L; i++)
+	    {
+		double &joint = m_joints[i * m_stride + b];
+		if(joint - dtheta > 0)
+		{
+		    dtheta -= joint;
+		    joint = 0;
+		}
+		else
+		{
+		    joint -= dtheta;
+		    break;
+		}
+	    }
+	}
+    }
+}
+
+/**
+ * ManipSimulator::FK for every active instance, one link at a time across the
+ * batch: cumulative angles, the chain relative to the base, then the offset by
+ * the base (the same operations as the incremental FK, so the same positions).
+ */
+void BatchSimulator::FK(const int begin, const int end)
+{
+    const int L = m_nrLinks;
+
+    for(int i = 0; i < L; ++i)
+    {
+	const double *joints = &m_joints[i * m_stride];
+	const double *prev   = i > 0 ? &m_absAngles[(i - 1) * m_stride] : NULL;
+	double       *angles = &m_absAngles[i * m_stride];
+	const double *x0     = &m_chainX[i * m_stride];
+	const double *y0     = &m_chainY[i * m_stride];
+	double       *x1     = &m_chainX[(i + 1) * m_stride];
+	double       *y1     = &m_chainY[(i + 1) * m_stride];
+
+	for(int b = begin; b < end; ++b)
+	{
+	    if(!m_active[b])
+		continue;
+
+	    double angle = prev ? prev[b] : 0;
+	    angle += joints[b];
+	    angles[b] = angle;
+	    x1[b]     = x0[b] + m_linkLength * cos(angle);
+	    y1[b]     = y0[b] + m_linkLength * sin(angle);
+	}
+    }
+
+    for(int i = 0; i <= L; ++i)
+    {
+	const double *cx = &m_chainX[i * m_stride];
+	const double *cy = &m_chainY[i * m_stride];
+	double       *px = &m_posX[i * m_stride];
+	double       *py = &m_posY[i * m_stride];
+
+	for(int b = begin; b < end; ++b)
+	    if(m_active[b])
+	    {
+		px[b] = cx[b] + m_baseX[b];
+		py[b] = cy[b] + m_baseY[b];
+	    }
+    }
+}
@@ -0,0 +1,256 @@
+/**
+ *@file BatchSimulator.hpp
+ *@brief Many independent electrodes advanced in lockstep, for Monte Carlo
+ *       studies. Each instance has its own planner parameters and anatomy
+ *       and follows exactly the trajectory that ManipPlanner::ConfigurationMove
+ *       and ManipSimulator::ApplyMove would give it (see RunInsertion), but
+ *       the state of all instances is stored as structure-of-arrays and each
+ *       tick runs phase by phase over the whole batch.
+ */
+
+#ifndef BATCH_SIMULATOR_HPP_
+#define BATCH_SIMULATOR_HPP_
+
+#include "DamageTracker.hpp"
+#include "InsertionRunner.hpp"
+#include "ManipPlanner.hpp"
+#include "ThreadPool.hpp"
+#include <vector>
+
+class BatchSimulator
+{
+public:
+    /**
+     *@brief All instances share the electrode design (as in ManipSimulator::SetupLinks)
+     */
+    BatchSimulator(const int nrLinks, const double linkLength);
+
+    ~BatchSimulator(void);
+
+    /**
+     *@brief Adds an electrode at the start of an insertion into the given anatomy.
+     *       The anatomy is only read and must outlive the batch.
+     *
+     *@return index of the new instance
+     */
+    int AddInstance(const Anatomy * const anatomy, const PlannerParameters &params);
+
+    /**
+     *@brief Advances every active instance by one tick; instances that are fully
+     *       inserted, reached the goal or used up maxTicks (<= 0: no limit) are
+     *       masked out. Blocks of instances run in parallel on pool, if given.
+     *
+     *@return number of instances still active
+     */
+    int Step(const int maxTicks, ThreadPool *pool = NULL);
+
+    /**
+     *@brief Steps until no instance is active
+     */
+    void Run(const int maxTicks, ThreadPool *pool = NULL);
+
+    int GetNrInstances(void) const
+    {
+	return m_nrInstances;
+    }
+
+    bool IsActive(const int b) const
+    {
+	return m_active[b] != 0;
+    }
+
+    /**
+     *@brief Outcome of instance b so far, as RunInsertion reports it (without timings)
+     */
+    InsertionResult GetResult(const int b) const;
+
+    /**
+     *@brief Base position and joint angles of instance b
+     */
+    void GetConfiguration(const int b, ElectrodeConfiguration &config) const;
+
+    /**
+     *@brief Wall cells scraped by instance b; the newly damaged ones are
+     *       those of its last tick
+     */
+    const DamageTracker& GetDamage(const int b) const
+    {
+	return m_lanes[b].damage;
+    }
+
+    /**
+     *@brief Step size and clearance of the last move of instance b
+     *       (ManipPlanner::GetLastStepSize and GetLastClearance)
+     */
+    double GetStepSize(const int b) const
+    {
+	return m_stepSize[b];
+    }
+
+    double GetClearance(const int b) const
+    {
+	return m_clearance[b];
+    }
+
+    int GetStage(const int b) const
+    {
+	return m_stage[b];
+    }
+
+    double GetBaseX(const int b) const
+    {
+	return m_baseX[b];
+    }
+
+    double GetBaseY(const int b) const
+    {
+	return m_baseY[b];
+    }
+
+    double GetLinkTheta(const int b, const int i) const
+    {
+	return m_joints[i * m_stride + b];
+    }
+
+    double GetLinkStartX(const int b, const int i) const
+    {
+	return m_posX[i * m_stride + b];
+    }
+
+    double GetLinkStartY(const int b, const int i) const
+    {
+	return m_posY[i * m_stride + b];
+    }
+
+protected:
+    //per-instance data whose size depends on the anatomy or on what was sensed
+    struct Lane
+    {
+	const Anatomy       *anatomy;
+	std::vector<char>    sensed;
+	DamageTracker        damage;
+	std::vector<double>  sensedX;
+	std::vector<double>  sensedY;
+	std::vector<double>  sensedR;
+
+	//configuration at the last swept collision check
+	ElectrodeConfiguration previous;
+    };
+
+    //per-block scratch buffers (blocks may run on different threads)
+    struct Scratch
+    {
+	std::vector<int>    nearby;
+	std::vector<double> closestX;
+	std::vector<double> closestY;
+	std::vector<double> centerDist;
+
+	//swept stepping
+	SweptCollision         sweep;
+	ElectrodeConfiguration from;
+	ElectrodeConfiguration to;
+    };
+
+    /**
+     *@brief Grows the per-link arrays to hold at least n instances
+     */
+    void Reserve(const int n);
+
+    /**
+     *@brief One tick for the active instances in [begin, end)
+     */
+    void StepBlock(const int begin, const int end, const int maxTicks, Scratch &scratch);
+
+    void ScanOCT(const int begin, const int end, Scratch &scratch);
+    void CollisionChecker(const int begin, const int end, Scratch &scratch);
+    void UpdateRetraction(const int begin, const int end);
+    void ComputeMoves(const int begin, const int end, Scratch &scratch);
+    void ApplyMoves(const int begin, const int end);
+    void FK(const int begin, const int end);
+    void UpdateActive(const int begin, const int end, const int maxTicks);
+
+    /**
+     *@brief Workspace repulsive force on the end of link j of instance b
+     */
+    Point RepulsiveForceAtLink(const int b, const int j) const;
+
+    /**
+     *@brief Adds the configuration space force for force f acting on the end of link j
+     *       of instance b to the instance's move (ManipPlanner::WSF2CSF, summed as
+     *       ConfigurationMove does)
+     */
+    void AddCSF(const int b, const int j, const Point f);
+
+    /**
+     *@brief ManipPlanner::ClipMoveAtFirstContact for instance b
+     */
+    void ClipMoveAtFirstContact(const int b, Scratch &scratch);
+
+    //angle of the last link w.r.t. the x-axis, in [0, 2 PI)
+    double GetTipAngle(const int b) const;
+
+    bool HasReachedGoal(const int b) const;
+
+    int    m_nrLinks;
+    double m_linkLength;
+    int    m_nrInstances;
+
+    //per-link arrays hold link i of instance b at [i * m_stride + b]
+    int    m_stride;
+
+    //start of an insertion, joint limits and goal (taken from ManipSimulator)
+    double              m_startX;
+    double              m_startY;
+    std::vector<double> m_thetaLimits;
+    double              m_goalX;
+    double              m_goalY;
+    double              m_goalRadius;
+    double              m_electrodeLength;
+    std::vector<double> m_lengths;
+
+    //electrode state
+    std::vector<double> m_joints;
+    std::vector<double> m_absAngles;
+    std::vector<double> m_chainX;
+    std::vector<double> m_chainY;
+    std::vector<double> m_posX;
+    std::vector<double> m_posY;
+    std::vector<double> m_baseX;
+    std::vector<double> m_baseY;
+
+    //planner state
+    std::vector<int>    m_stage;
+    std::vector<int>    m_retraction;
+    std::vector<char>   m_sensedFront;
+    std::vector<double> m_alpha;
+    std::vector<double> m_gamma;
+    std::vector<double> m_Q;
+    std::vector<double> m_beta;
+    std::vector<double> m_betaFactor;
+    std::vector<double> m_alphaFactor;
+    std::vector<double> m_maxOCTDepth;
+    std::vector<double> m_angleBandwidth;
+    std::vector<char>   m_useDistanceField;
+    std::vector<char>   m_linkCollision;
+    std::vector<char>   m_sweptCollision;
+    std::vector<char>   m_adaptiveStep;
+    std::vector<double> m_stepSafety;
+    std::vector<double> m_minStepScale;
+    std::vector<double> m_maxStepScale;
+    std::vector<char>   m_sweptStep;
+
+    //move of the current tick
+    std::vector<double> m_deltaTheta;
+    std::vector<double> m_deltaX;
+    std::vector<double> m_deltaY;
+    std::vector<double> m_stepSize;
+    std::vector<double> m_clearance;
+
+    //bookkeeping
+    std::vector<char>   m_active;
+    std::vector<int>    m_ticks;
+    std::vector<Lane>   m_lanes;
+    std::vector<Scratch> m_scratch;
+};
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ *@file BenchPlanner.cpp
+ *@brief Benchmarks the simulator and planner hot paths and whole insertions
+ *       over anatomies (files or synthetic spirals) and electrode designs,
+ *       and writes the timings as CSV or JSON
+ */
+
+#include "AnatomyGenerator.hpp"
+#include "PlannerBenchmark.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+template <typename T>
+static void ReadList(const char text[], std::vector<T> &values)
+{
+    std::istringstream list(text);
+    std::string        item;
+    values.clear();
+    while(std::getline(list, item, ','))
+    {
+	std::istringstream value(item);
+	T                  v;
+	if(value >> v)
+	    values.push_back(v);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    std::vector<double>      spiralSteps;
+    std::vector<int>         nrLinks(1, 8);
+    std::vector<double>      linkLengths(1, 1.0);
+    BenchmarkParameters      params;
+    bool                     json      = false;
+    const char              *output    = NULL;
+    const char              *baseline  = NULL;
+    double                   tolerance = 0.25;
+    for(int i = 1; i < argc; ++i)
+    {
+	if(strcmp(argv[i], "--spiral") == 0 && i + 1 < argc)
+	    spiralSteps.push_back(atof(argv[++i]));
+	else if(strcmp(argv[i], "--links") == 0 && i + 1 < argc)
+	    ReadList(argv[++i], nrLinks);
+	else if(strcmp(argv[i], "--lengths") == 0 && i + 1 < argc)
+	    ReadList(argv[++i], linkLengths);
+	else if(strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+	    params.minSeconds = atof(argv[++i]);
+	else if(strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+	    params.repetitions = atoi(argv[++i]);
+	else if(strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc)
+	    params.maxTicks = atoi(argv[++i]);
+	else if(strcmp(argv[i], "--json") == 0)
+	    json = true;
+	else if(strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+	    output = argv[++i];
+	else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+	    baseline = argv[++i];
+	else if(strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+	    tolerance = atof(argv[++i]);
+	else
+	    files.push_back(argv[i]);
+    }
+
+    if((files.empty() && spiralSteps.empty()) || nrLinks.empty() || linkLengths.empty())
+    {
+	printf("missing arguments\n");
+	printf("  BenchPlanner [obstacle files] [--spiral <angleStepDeg>]... [--links <n,...>]\n");
+	printf("               [--lengths <l,...>] [--min-time <s>] [--repetitions <n>] [--max-ticks <n>]\n");
+	printf("               [--json] [--output <file>] [--baseline <csv>] [--tolerance <fraction>]\n");
+	printf("  e.g. BenchPlanner bin/cochlea_*.txt --spiral 0.25 --spiral 0.0625 --links 8,12\n");
+	return 0;
+    }
+
+    //the anatomies, loaded or generated once and shared by all the runs
+    std::vector<std::string> names;
+    std::vector<Anatomy*>    anatomies;
+    for(int i = 0; i < (int) files.size(); ++i)
+    {
+	Anatomy *anatomy = new Anatomy();
+	if(!anatomy->LoadFromFile(files[i].c_str()))
+	{
+	    delete anatomy;
+	    return 1;
+	}
+	names.push_back(files[i]);
+	anatomies.push_back(anatomy);
+    }
+    for(int i = 0; i < (int) spiralSteps.size(); ++i)
+    {
+	//the spiral of cochlea_male_A943.txt, sampled more densely
+	SpiralParameters spiral;
+	spiral.angleStep = spiralSteps[i] / 180 * M_PI;
+
+	char name[64];
+	snprintf(name, sizeof(name), "spiral_%gdeg", spiralSteps[i]);
+	Anatomy *anatomy = new Anatomy();
+	GenerateSpiralAnatomy(spiral, *anatomy);
+	names.push_back(name);
+	anatomies.push_back(anatomy);
+    }
+
+    std::vector<BenchmarkResult> results;
+    for(int a = 0; a < (int) anatomies.size(); ++a)
+	for(int l = 0; l < (int) nrLinks.size(); ++l)
+	    for(int k = 0; k < (int) linkLengths.size(); ++k)
+	    {
+		//progress on stderr, so the results can go to stdout
+		fprintf(stderr, "%s (%d obstacles), %d links of %g\n", names[a].c_str(),
+			anatomies[a]->GetNrObstacles(), nrLinks[l], linkLengths[k]);
+		PlannerBenchmark::RunKernels(names[a], *anatomies[a], nrLinks[l], linkLengths[k], params, results);
+		PlannerBenchmark::RunInsertion(names[a], *anatomies[a], nrLinks[l], linkLengths[k], params, results);
+	    }
+
+    for(int a = 0; a < (int) anatomies.size(); ++a)
+	delete anatomies[a];
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if(out == NULL)
+    {
+	printf("error: cannot write %s\n", output);
+	return 1;
+    }
+    if(json)
+	WriteBenchmarkJSON(out, results);
+    else
+	WriteBenchmarkCSV(out, results);
+    if(out != stdout)
+	fclose(out);
+
+    //regressions against an earlier run fail the command, for scripted checks
+    if(baseline)
+    {
+	std::vector<BenchmarkResult> previous;
+	if(!LoadBenchmarkCSV(baseline, previous))
+	    return 1;
+	const int nrRegressions = CompareBenchmarks(stderr, results, previous, tolerance);
+	fprintf(stderr, "%d regression(s) over %.0f%% against %s\n", nrRegressions, 100 * tolerance, baseline);
+	return nrRegressions > 0 ? 1 : 0;
+    }
+
+    return 0;
+}
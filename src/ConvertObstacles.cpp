@@ -0,0 +1,32 @@
+/**
+ *@file ConvertObstacles.cpp
+ *@brief Converts an obstacle file (text or binary) into the binary,
+ *       memory-mappable obstacle format
+ */
+
+#include "Anatomy.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+	printf("missing arguments\n");		
+	printf("  ConvertObstacles <input obstacle file> <output binary file> [--no-index] \n");
+	return 0;		
+    }
+
+    const bool withIndex = !(argc > 3 && strcmp(argv[3], "--no-index") == 0);
+
+    Anatomy anatomy;
+    if(!anatomy.LoadFromFile(argv[1]))
+	return 1;
+    
+    if(!anatomy.SaveBinary(argv[2], withIndex))
+	return 1;
+    
+    printf("wrote %d obstacles%s to %s\n", anatomy.GetNrObstacles(), withIndex ? " and grid" : "", argv[2]);
+    return 0;
+}
@@ -0,0 +1,16 @@
+#include "DamageTracker.hpp"
+
+DamageTracker::DamageTracker(void)
+{
+    m_nrCells   = 0;
+    m_tickBegin = 0;
+}
+
+void DamageTracker::Reset(const int nrCells)
+{
+    m_nrCells = nrCells;
+    m_bits.assign((nrCells + 63) / 64, 0);
+    m_damaged.clear();
+    m_damaged.reserve(nrCells);
+    m_tickBegin = 0;
+}
@@ -0,0 +1,101 @@
+/**
+ *@file DamageTracker.hpp
+ *@brief Incremental record of which wall cells the electrode has scraped
+ */
+
+#ifndef DAMAGE_TRACKER_HPP_
+#define DAMAGE_TRACKER_HPP_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Damaged cells are kept as a dense bitset plus a running count, so marking a
+ * cell and reading the total are O(1). The cells are also listed in the order
+ * they were first damaged, and the ones damaged since the last BeginTick form
+ * the "newly damaged" list, so that rendering and logging can work from the
+ * delta instead of scanning every cell.
+ */
+class DamageTracker
+{
+public:
+    DamageTracker(void);
+
+    /**
+     *@brief Forgets all damage and sizes the tracker for nrCells cells. Every
+     *       buffer is reserved here, so marking cells never allocates.
+     */
+    void Reset(const int nrCells);
+
+    /**
+     *@brief Starts a new tick: empties the newly damaged list
+     */
+    void BeginTick(void)
+    {
+	m_tickBegin = m_damaged.size();
+    }
+
+    /**
+     *@brief Marks cell i as damaged
+     *
+     *@return true if it was not damaged before
+     */
+    bool MarkDamaged(const int i)
+    {
+	uint64_t &word = m_bits[i >> 6];
+	const uint64_t bit = ((uint64_t) 1) << (i & 63);
+	if(word & bit)
+	    return false;
+	word |= bit;
+	m_damaged.push_back(i);
+	return true;
+    }
+
+    bool IsDamaged(const int i) const
+    {
+	return (m_bits[i >> 6] >> (i & 63)) & 1;
+    }
+
+    int GetNrCells(void) const
+    {
+	return m_nrCells;
+    }
+
+    int GetNrDamaged(void) const
+    {
+	return m_damaged.size();
+    }
+
+    /**
+     *@brief All damaged cells, in the order they were first damaged
+     */
+    const std::vector<int>& GetDamagedCells(void) const
+    {
+	return m_damaged;
+    }
+
+    /**
+     *@brief Cells damaged since the last BeginTick; they are the last
+     *       GetNrNewlyDamaged() entries of GetDamagedCells()
+     */
+    const int* GetNewlyDamaged(void) const
+    {
+	return m_damaged.empty() ? NULL : &m_damaged[0] + m_tickBegin;
+    }
+
+    int GetNrNewlyDamaged(void) const
+    {
+	return m_damaged.size() - m_tickBegin;
+    }
+
+protected:
+    int                   m_nrCells;
+    std::vector<uint64_t> m_bits;
+
+    //the running count is m_damaged.size()
+    std::vector<int>      m_damaged;
+    int                   m_tickBegin;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "DistanceField.hpp"
+#include <algorithm>
+#include <cmath>
+
+DistanceFieldParameters::DistanceFieldParameters(void)
+{
+    resolution  = 0.02;
+    maxDistance = 2;
+    minX = minY = 0;
+    maxX = maxY = 0;
+}
+
+DistanceField::DistanceField(void)
+{
+    m_minX = m_minY = 0;
+    m_resolution  = 1;
+    m_maxDistance = 0;
+    m_nrNodesX = m_nrNodesY = 0;
+}
+
+DistanceField::~DistanceField(void)
+{
+}
+
+void DistanceField::Build(const ObstacleSet &obstacles, const ObstacleGrid &grid, const DistanceFieldParameters &params)
+{
+    const int n = obstacles.GetNrObstacles();
+    
+    m_resolution  = params.resolution > 0 ? params.resolution : 0.02;
+    m_maxDistance = params.maxDistance;
+    m_distances.clear();
+    m_nrNodesX = m_nrNodesY = 0;
+    
+    double minX = params.minX, minY = params.minY, maxX = params.maxX, maxY = params.maxY;
+    if(minX >= maxX || minY >= maxY)
+    {
+	if(n == 0)
+	    return;
+	
+	minX = maxX = obstacles.GetCenterX(0);
+	minY = maxY = obstacles.GetCenterY(0);
+	for(int i = 0; i < n; ++i)
+	{
+	    minX = std::min(minX, obstacles.GetCenterX(i) - obstacles.GetRadius(i));
+	    minY = std::min(minY, obstacles.GetCenterY(i) - obstacles.GetRadius(i));
+	    maxX = std::max(maxX, obstacles.GetCenterX(i) + obstacles.GetRadius(i));
+	    maxY = std::max(maxY, obstacles.GetCenterY(i) + obstacles.GetRadius(i));
+	}
+	minX -= m_maxDistance;
+	minY -= m_maxDistance;
+	maxX += m_maxDistance;
+	maxY += m_maxDistance;
+    }
+    
+    m_minX     = minX;
+    m_minY     = minY;
+    m_nrNodesX = 2 + (int) ((maxX - minX) / m_resolution);
+    m_nrNodesY = 2 + (int) ((maxY - minY) / m_resolution);
+    m_distances.resize((size_t) m_nrNodesX * m_nrNodesY);
+    
+    //only obstacles whose surface is within maxDistance of a node matter
+    const double     reach = m_maxDistance + grid.GetMaxRadius();
+    std::vector<int> ids;
+    
+    for(int iy = 0; iy < m_nrNodesY; ++iy)
+	for(int ix = 0; ix < m_nrNodesX; ++ix)
+	{
+	    const double x = m_minX + ix * m_resolution;
+	    const double y = m_minY + iy * m_resolution;
+	    double       d = m_maxDistance;
+	    
+	    grid.GetObstaclesWithinDist(x, y, reach, ids);
+	    for(int k = 0; k < (int) ids.size(); ++k)
+	    {
+		const int    i  = ids[k];
+		const double dx = obstacles.GetCenterX(i) - x;
+		const double dy = obstacles.GetCenterY(i) - y;
+		d = std::min(d, sqrt(dx * dx + dy * dy) - obstacles.GetRadius(i));
+	    }
+	    m_distances[(size_t) iy * m_nrNodesX + ix] = d;
+	}
+}
+
+double DistanceField::Sample(const double x, const double y, double &gradX, double &gradY) const
+{
+    gradX = gradY = 0;
+    
+    const double u = (x - m_minX) / m_resolution;
+    const double v = (y - m_minY) / m_resolution;
+    if(!(u >= 0 && v >= 0 && u < m_nrNodesX - 1 && v < m_nrNodesY - 1))
+	return m_maxDistance;
+    
+    const int     ix  = (int) u;
+    const int     iy  = (int) v;
+    const double  fu  = u - ix;
+    const double  fv  = v - iy;
+    const double *row = &m_distances[(size_t) iy * m_nrNodesX + ix];
+    const double  d00 = row[0];
+    const double  d10 = row[1];
+    const double  d01 = row[m_nrNodesX];
+    const double  d11 = row[m_nrNodesX + 1];
+    
+    //derivative of the bilinear interpolant inside the cell
+    const double gx = ((1 - fv) * (d10 - d00) + fv * (d11 - d01)) / m_resolution;
+    const double gy = ((1 - fu) * (d01 - d00) + fu * (d11 - d10)) / m_resolution;
+    const double g  = sqrt(gx * gx + gy * gy);
+    if(g > 0)
+    {
+	gradX = gx / g;
+	gradY = gy / g;
+    }
+    
+    return (1 - fv) * ((1 - fu) * d00 + fu * d10) + fv * ((1 - fu) * d01 + fu * d11);
+}
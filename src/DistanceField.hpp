@@ -0,0 +1,79 @@
+/**
+ *@file DistanceField.hpp
+ *@brief Signed distance to the cochlea walls, rasterized on a regular grid
+ *       and sampled with bilinear interpolation
+ */
+
+#ifndef DISTANCE_FIELD_HPP_
+#define DISTANCE_FIELD_HPP_
+
+#include "ObstacleGrid.hpp"
+#include "ObstacleSet.hpp"
+#include <vector>
+
+struct DistanceFieldParameters
+{
+    DistanceFieldParameters(void);
+    
+    //spacing of the grid nodes
+    double resolution;
+    
+    //distances are clamped to maxDistance (beyond it, walls exert no force anyway)
+    double maxDistance;
+    
+    //rasterized region; if minX >= maxX (the default), the bounding box of the
+    //obstacles grown by maxDistance is used
+    double minX;
+    double minY;
+    double maxX;
+    double maxY;
+};
+
+class DistanceField
+{
+public:
+    DistanceField(void);
+    
+    ~DistanceField(void);
+
+    /**
+     *@brief Computes, at every grid node, the signed distance to the closest wall circle
+     *       surface (negative inside a circle), clamped to params.maxDistance
+     */
+    void Build(const ObstacleSet &obstacles, const ObstacleGrid &grid, const DistanceFieldParameters &params);
+
+    /**
+     *@brief Bilinear lookup of the signed distance at [x, y] and of its gradient
+     *       (normalized; zero where the field is flat). Outside the rasterized region
+     *       the distance is maxDistance and the gradient is zero.
+     */
+    double Sample(const double x, const double y, double &gradX, double &gradY) const;
+
+    double GetMaxDistance(void) const
+    {
+	return m_maxDistance;
+    }
+
+    int GetNrNodesX(void) const
+    {
+	return m_nrNodesX;
+    }
+
+    int GetNrNodesY(void) const
+    {
+	return m_nrNodesY;
+    }
+
+protected:
+    double m_minX;
+    double m_minY;
+    double m_resolution;
+    double m_maxDistance;
+    int    m_nrNodesX;
+    int    m_nrNodesY;
+
+    //node (ix, iy) is at [m_minX + ix * m_resolution, m_minY + iy * m_resolution]
+    std::vector<double> m_distances;
+};
+
+#endif
@@ -0,0 +1,320 @@
+#include "GainTuner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+TuningSpec::TuningSpec(void)
+{
+    nrLinks           = 8;
+    linkLength        = 1;
+    maxTicks          = 5000;
+    tickWeight        = 0;
+    incompletePenalty = 1000;
+    maxEvaluations    = 200;
+    initialStep       = 0.3;
+
+    tunedGains.push_back("alpha");
+    tunedGains.push_back("gamma");
+    tunedGains.push_back("Q");
+    tunedGains.push_back("beta");
+}
+
+//the gain of params called name, or NULL if there is none
+static double* GetGain(PlannerParameters &params, const std::string &name)
+{
+    if(name == "alpha")
+	return &params.alpha;
+    if(name == "gamma")
+	return &params.gamma;
+    if(name == "Q")
+	return &params.Q;
+    if(name == "beta")
+	return &params.beta;
+    if(name == "localMinimumBetaFactor")
+	return &params.localMinimumBetaFactor;
+    if(name == "localMinimumAlphaFactor")
+	return &params.localMinimumAlphaFactor;
+    if(name == "MAX_OCT_DEPTH")
+	return &params.maxOCTDepth;
+    if(name == "ANGLE_BANDWIDTH")
+	return &params.angleBandwidth;
+    return NULL;
+}
+
+bool LoadTuningSpec(const char fname[], TuningSpec &spec)
+{
+    FILE *in = fopen(fname, "r");
+    if(in == NULL)
+    {
+	printf("error: cannot open tuning file %s\n", fname);
+	return false;
+    }
+
+    char buffer[4096];
+    bool ok = true;
+    while(ok && fgets(buffer, sizeof(buffer), in))
+    {
+	std::istringstream line(buffer);
+	std::string        key, value;
+	double            *gain;
+
+	if(!(line >> key) || key[0] == '#')
+	    continue;
+
+	if(key == "anatomy")
+	{
+	    spec.anatomies.clear();
+	    while(line >> value)
+		spec.anatomies.push_back(value);
+	}
+	else if(key == "tune")
+	{
+	    spec.tunedGains.clear();
+	    while(line >> value)
+		spec.tunedGains.push_back(value);
+	}
+	else if(key == "nLinks")
+	    ok = (bool) (line >> spec.nrLinks);
+	else if(key == "linkLength")
+	    ok = (bool) (line >> spec.linkLength);
+	else if(key == "maxTicks")
+	    ok = (bool) (line >> spec.maxTicks);
+	else if(key == "tickWeight")
+	    ok = (bool) (line >> spec.tickWeight);
+	else if(key == "incompletePenalty")
+	    ok = (bool) (line >> spec.incompletePenalty);
+	else if(key == "maxEvaluations")
+	    ok = (bool) (line >> spec.maxEvaluations);
+	else if(key == "initialStep")
+	    ok = (bool) (line >> spec.initialStep);
+	else if((gain = GetGain(spec.start, key)) != NULL)
+	    ok = (bool) (line >> *gain);
+	else
+	{
+	    printf("error: unknown tuning parameter %s\n", key.c_str());
+	    ok = false;
+	    break;
+	}
+
+	if(!ok)
+	    printf("error: missing value for %s\n", key.c_str());
+    }
+    fclose(in);
+
+    if(ok && spec.anatomies.empty())
+    {
+	printf("error: tuning needs at least one anatomy\n");
+	ok = false;
+    }
+
+    return ok;
+}
+
+/**
+ * Evaluates candidate gains (as logarithms of the tuned gains) on every anatomy,
+ * all insertions of a round in parallel, and keeps track of the best candidate.
+ */
+struct TuningEvaluator
+{
+    const TuningSpec             &spec;
+    ThreadPool                   &pool;
+    const std::vector<Anatomy*>  &anatomies;
+    FILE                         *log;
+    int                           nrEvaluations;
+    TuningEvaluation              best;
+
+    TuningEvaluator(const TuningSpec &s, ThreadPool &p, const std::vector<Anatomy*> &a, FILE *l) :
+	spec(s), pool(p), anatomies(a), log(l)
+    {
+	nrEvaluations = 0;
+	best.cost     = HUGE_VAL;
+    }
+
+    PlannerParameters GetParameters(const std::vector<double> &x) const
+    {
+	PlannerParameters params = spec.start;
+	for(int g = 0; g < (int) x.size(); ++g)
+	    *GetGain(params, spec.tunedGains[g]) = exp(x[g]);
+	return params;
+    }
+
+    void Evaluate(const std::vector< std::vector<double> > &xs, std::vector<double> &costs)
+    {
+	const int C = xs.size();
+	const int A = anatomies.size();
+
+	std::vector<PlannerParameters> params(C);
+	for(int c = 0; c < C; ++c)
+	    params[c] = GetParameters(xs[c]);
+
+	std::vector<InsertionResult> results(C * A);
+	pool.ParallelFor(C * A, [&](int k)
+	{
+	    ManipSimulator simulator(anatomies[k % A]);
+	    ManipPlanner   planner(&simulator, params[k / A]);
+
+	    simulator.SetupLinks(spec.nrLinks, spec.linkLength);
+	    results[k] = RunInsertion(&planner, &simulator, spec.maxTicks);
+	});
+
+	costs.resize(C);
+	for(int c = 0; c < C; ++c)
+	{
+	    TuningEvaluation e;
+	    e.params            = params[c];
+	    e.totalCellsDamaged = 0;
+	    e.ticks             = 0;
+	    e.nrCompleted       = 0;
+	    e.cost              = 0;
+	    for(int a = 0; a < A; ++a)
+	    {
+		const InsertionResult &r = results[c * A + a];
+		e.totalCellsDamaged += r.totalCellsDamaged;
+		e.ticks             += r.ticks;
+		e.nrCompleted       += r.completed;
+		e.cost              += r.totalCellsDamaged + spec.tickWeight * r.ticks + (r.completed ? 0 : spec.incompletePenalty);
+	    }
+	    e.cost  /= A;
+	    costs[c] = e.cost;
+
+	    if(e.cost < best.cost)
+		best = e;
+
+	    nrEvaluations++;
+	    if(log)
+	    {
+		fprintf(log, "%d,%g,%d,%d,%d,%g,%g,%g,%g,%g,%g,%g,%g\n", nrEvaluations, e.cost,
+			e.totalCellsDamaged, e.ticks, e.nrCompleted,
+			e.params.alpha, e.params.gamma, e.params.Q, e.params.beta,
+			e.params.localMinimumBetaFactor, e.params.localMinimumAlphaFactor,
+			e.params.maxOCTDepth, e.params.angleBandwidth);
+		fflush(log);
+	    }
+	}
+    }
+};
+
+//a + t * (a - b)
+static std::vector<double> Extrapolate(const std::vector<double> &a, const std::vector<double> &b, const double t)
+{
+    std::vector<double> x(a.size());
+    for(int i = 0; i < (int) a.size(); ++i)
+	x[i] = a[i] + t * (a[i] - b[i]);
+    return x;
+}
+
+bool TuneGains(const TuningSpec &spec, ThreadPool &pool, TuningEvaluation &best, FILE *logFile)
+{
+    const int n = spec.tunedGains.size();
+
+    //the search works on log(gain), so every tuned gain must start positive
+    PlannerParameters start = spec.start;
+    std::vector<double> x0(n);
+    for(int g = 0; g < n; ++g)
+    {
+	const double *gain = GetGain(start, spec.tunedGains[g]);
+	if(gain == NULL || !(*gain > 0))
+	{
+	    printf("error: cannot tune %s (unknown gain or not positive)\n", spec.tunedGains[g].c_str());
+	    return false;
+	}
+	x0[g] = log(*gain);
+    }
+
+    std::vector<Anatomy*> anatomies(spec.anatomies.size(), (Anatomy *) NULL);
+    bool ok = true;
+    for(int a = 0; a < (int) spec.anatomies.size(); ++a)
+    {
+	anatomies[a] = new Anatomy();
+	ok = anatomies[a]->LoadFromFile(spec.anatomies[a].c_str()) && ok;
+    }
+
+    if(ok)
+    {
+	if(logFile)
+	    fprintf(logFile, "evaluation,cost,cellsDamaged,ticks,completed,alpha,gamma,Q,beta,"
+		    "localMinimumBetaFactor,localMinimumAlphaFactor,MAX_OCT_DEPTH,ANGLE_BANDWIDTH\n");
+
+	TuningEvaluator evaluator(spec, pool, anatomies, logFile);
+
+	//initial simplex: the start and one step along each gain
+	std::vector< std::vector<double> > simplex(n + 1, x0);
+	std::vector<double>                costs;
+	for(int g = 0; g < n; ++g)
+	    simplex[g + 1][g] += log(1 + spec.initialStep);
+	evaluator.Evaluate(simplex, costs);
+
+	std::vector<int>                   order(n + 1);
+	std::vector< std::vector<double> > trials(4), shrunk;
+	std::vector<double>                trialCosts, shrunkCosts;
+
+	while(n > 0 && evaluator.nrEvaluations < spec.maxEvaluations)
+	{
+	    for(int i = 0; i <= n; ++i)
+		order[i] = i;
+	    std::sort(order.begin(), order.end(), [&](int a, int b) { return costs[a] < costs[b]; });
+	    const int bestVertex  = order[0];
+	    const int worstVertex = order[n];
+	    const int secondWorst = order[n - 1];
+
+	    //converged: all vertices (nearly) at the same point
+	    double size = 0;
+	    for(int i = 0; i <= n; ++i)
+		for(int g = 0; g < n; ++g)
+		    size = std::max(size, fabs(simplex[i][g] - simplex[bestVertex][g]));
+	    if(size < 1e-4)
+		break;
+
+	    std::vector<double> centroid(n, 0.0);
+	    for(int i = 0; i <= n; ++i)
+		if(i != worstVertex)
+		    for(int g = 0; g < n; ++g)
+			centroid[g] += simplex[i][g] / n;
+
+	    //reflection, expansion, outside and inside contraction, evaluated together
+	    trials[0] = Extrapolate(centroid, simplex[worstVertex], 1);
+	    trials[1] = Extrapolate(centroid, simplex[worstVertex], 2);
+	    trials[2] = Extrapolate(centroid, simplex[worstVertex], 0.5);
+	    trials[3] = Extrapolate(centroid, simplex[worstVertex], -0.5);
+	    evaluator.Evaluate(trials, trialCosts);
+
+	    const double fr = trialCosts[0];
+	    int accept = -1;
+	    if(fr < costs[bestVertex])
+		accept = trialCosts[1] < fr ? 1 : 0;
+	    else if(fr < costs[secondWorst])
+		accept = 0;
+	    else if(fr < costs[worstVertex])
+		accept = trialCosts[2] <= fr ? 2 : -1;
+	    else
+		accept = trialCosts[3] < costs[worstVertex] ? 3 : -1;
+
+	    if(accept >= 0)
+	    {
+		simplex[worstVertex] = trials[accept];
+		costs[worstVertex]   = trialCosts[accept];
+		continue;
+	    }
+
+	    //shrink everything toward the best vertex
+	    shrunk.clear();
+	    for(int i = 0; i <= n; ++i)
+		if(i != bestVertex)
+		    shrunk.push_back(Extrapolate(simplex[bestVertex], simplex[i], -0.5));
+	    evaluator.Evaluate(shrunk, shrunkCosts);
+	    for(int i = 0, k = 0; i <= n; ++i)
+		if(i != bestVertex)
+		{
+		    simplex[i] = shrunk[k];
+		    costs[i]   = shrunkCosts[k++];
+		}
+	}
+
+	best = evaluator.best;
+    }
+
+    for(int a = 0; a < (int) anatomies.size(); ++a)
+	delete anatomies[a];
+
+    return ok;
+}
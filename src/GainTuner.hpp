@@ -0,0 +1,85 @@
+/**
+ *@file GainTuner.hpp
+ *@brief Derivative-free search (Nelder-Mead) over the planner gains that
+ *       minimizes the damage done over a set of anatomies
+ */
+
+#ifndef GAIN_TUNER_HPP_
+#define GAIN_TUNER_HPP_
+
+#include "InsertionRunner.hpp"
+#include "ThreadPool.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * What to tune and how to score it. Read from a text file in the format of
+ * the sweep files (see SweepRunner.hpp), e.g.
+ *
+ *   anatomy bin/cochlea_A915.txt bin/cochlea_A960.txt
+ *   nLinks 8
+ *   linkLength 1
+ *   maxTicks 5000
+ *   tune alpha gamma Q beta
+ *   tickWeight 0.01
+ *
+ * Valid keys: anatomy, nLinks, linkLength, maxTicks, the starting values of
+ * the gains (alpha, gamma, Q, beta, localMinimumBetaFactor,
+ * localMinimumAlphaFactor, MAX_OCT_DEPTH, ANGLE_BANDWIDTH), tune (gains to
+ * search over, by those names), tickWeight, incompletePenalty,
+ * maxEvaluations and initialStep.
+ */
+struct TuningSpec
+{
+    TuningSpec(void);
+
+    std::vector<std::string> anatomies;
+    int                      nrLinks;
+    double                   linkLength;
+    int                      maxTicks;
+
+    //starting point; the gains not listed in tunedGains keep these values
+    PlannerParameters        start;
+    std::vector<std::string> tunedGains;
+
+    //cost of a candidate = mean over the anatomies of
+    //  totalCellsDamaged + tickWeight * ticks + (not completed ? incompletePenalty : 0)
+    double                   tickWeight;
+    double                   incompletePenalty;
+
+    //budget (number of candidates evaluated, each on every anatomy)
+    int                      maxEvaluations;
+
+    //size of the initial simplex, relative to the starting gains
+    double                   initialStep;
+};
+
+struct TuningEvaluation
+{
+    PlannerParameters params;
+    double            cost;
+
+    //summed over the anatomies
+    int               totalCellsDamaged;
+    int               ticks;
+    int               nrCompleted;
+};
+
+/**
+ *@brief Reads a tuning specification; prints an error and returns false on failure
+ */
+bool LoadTuningSpec(const char fname[], TuningSpec &spec);
+
+/**
+ *@brief Runs Nelder-Mead over the logarithm of the tuned gains (so they stay positive).
+ *       Every simplex step evaluates its reflection, expansion and both contractions
+ *       at once, and all their insertions (candidates x anatomies) run in parallel
+ *       on the pool.
+ *
+ *@param logFile if not NULL, one CSV row is written per evaluated candidate
+ *@return false if an anatomy or a gain name is invalid
+ */
+bool TuneGains(const TuningSpec &spec, ThreadPool &pool, TuningEvaluation &best, FILE *logFile);
+
+#endif
@@ -1,4 +1,8 @@
 #include "Graphics.hpp"
+#include "RRTConnectPlanner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
 #ifdef __APPLE__
 #include <GLUT/glut.h>
@@ -10,33 +14,84 @@
 
 Graphics *m_graphics = NULL;
 
-Graphics::Graphics(const char fname[], const int nrLinks, const double linkLength) 
+Graphics::Graphics(const char fname[], const int nrLinks, const double linkLength, const bool useRRT) 
 {
     ManipSimulator* m_sim = new ManipSimulator(fname);
+    
+    //anatomies do not change between launches: map the cached nearest-wall table
+    m_sim->m_ownedAnatomy->LoadNearestWallTable(NearestWallParameters());
     m_planner                = new ManipPlanner(m_sim);
 
-    m_planner->m_manipSimulator->theta_limits.resize(nrLinks);
-    for(int i = 0; i < nrLinks; ++i)
+    m_sim->SetupLinks(nrLinks, linkLength);
+
+    if(useRRT)
     {
-	m_planner->m_manipSimulator->AddLink(linkLength);
-        m_planner->m_manipSimulator->theta_limits[i] = -(4.0/3*M_PI)/nrLinks + ((nrLinks-i+0.0)/nrLinks*(13))/180*M_PI; //backoff varies from 13 to 0
+	RRTConnectPlanner rrt(m_sim);
+	if(rrt.Plan(m_trajectory))
+	{
+	    printf("RRT: %d moves planned in %.3f s\n", (int) m_trajectory.moves.size(), rrt.GetStatistics().seconds);
+	    m_planner->SetTrajectory(&m_trajectory);
+	}
+	else
+	    printf("RRT: no collision-free insertion found, using the potential field\n");
     }
-    m_planner->m_manipSimulator->FK();
+
+    for(int i = 0; i <= NR_CIRCLE_SIDES; ++i)
+    {
+	m_unitCircle[2 * i]     = cos(i * 2 * M_PI / NR_CIRCLE_SIDES);
+	m_unitCircle[2 * i + 1] = sin(i * 2 * M_PI / NR_CIRCLE_SIDES);
+    }
+    m_wallList      = 0;
+    m_wallListDirty = true;
 
     m_selectedCircle = -1;
     m_editRadius     = false;
     m_run = false;
+    m_replay      = false;
+    m_replaySpeed = 1;
+    m_rewind      = false;
+    
+    m_ticksPerSecond = 1000.0 / 15;
+    m_tick           = 0;
+    m_quit           = false;
     
 }
 
 Graphics::~Graphics(void)
 {
+    StopSimulation();
 	if(m_planner->m_manipSimulator)
 		delete m_planner->m_manipSimulator;
     if(m_planner)
 	delete m_planner;
 }
 
+bool Graphics::Record(const char fname[])
+{
+    return m_recorder.Open(fname, *m_planner->m_manipSimulator);
+}
+
+bool Graphics::Replay(const char fname[])
+{
+    ManipSimulator *sim = m_planner->m_manipSimulator;
+    if(!m_reader.Open(fname))
+	return false;
+    if(m_reader.GetNrLinks() != sim->GetNrLinks() || m_reader.GetNrObstacles() != sim->GetNrObstacles())
+    {
+	printf("error: %s was recorded with %d links and %d obstacles, not %d and %d\n", fname,
+	       m_reader.GetNrLinks(), m_reader.GetNrObstacles(), sim->GetNrLinks(), sim->GetNrObstacles());
+	return false;
+    }
+    
+    m_replay = true;
+    m_frame.tick   = 0;
+    m_frame.stage  = 0;
+    m_frame.config = m_reader.GetInitialConfiguration();
+    m_replayDamage.Reset(sim->GetNrObstacles());
+    sim->SetConfiguration(m_frame.config);
+    return true;
+}
+
 void Graphics::MainLoop(void)
 {	
     m_graphics = this;
@@ -59,40 +114,119 @@ void Graphics::MainLoop(void)
     glutTimerFunc(15, CallbackEventOnTimer, 0); 
     glutKeyboardFunc(CallbackEventOnKeyPress);
 
+//start the simulation, from the state shown before the first tick
+    PublishSnapshot();
+    m_simThread = std::thread(&Graphics::SimulationLoop, this);
+
 //enter main event loop
     glutMainLoop();	
 }
 
-void Graphics::HandleEventOnTimer(void)
+void Graphics::SimulationLoop(void)
 {
-    if(m_run && !m_planner->m_manipSimulator->HasRobotReachedGoal())
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point next = Clock::now();
+    
+    while(!m_quit)
     {
-	m_planner->ConfigurationMove(m_dtheta, m_dx, m_dy);
-	m_planner->m_manipSimulator->base_x += m_dx;
-	m_planner->m_manipSimulator->base_y += m_dy;
-        m_planner->m_manipSimulator->AddToLinkTheta(m_dtheta);
-	m_planner->m_manipSimulator->FK();
+	if(m_rewind.exchange(false))
+	{
+	    m_reader.Rewind();
+	    m_frame.tick   = 0;
+	    m_frame.config = m_reader.GetInitialConfiguration();
+	    m_replayDamage.Reset(m_planner->m_manipSimulator->GetNrObstacles());
+	    m_planner->m_manipSimulator->SetConfiguration(m_frame.config);
+	    PublishSnapshot();
+	}
+	
+	//paused, or done: check again about once a frame
+	if(!m_run || !SimulationStep())
+	{
+	    std::this_thread::sleep_for(std::chrono::milliseconds(15));
+	    next = Clock::now();
+	    continue;
+	}
+	PublishSnapshot();
+	
+	//at the requested rate; a late tick does not make the next ones faster
+	if(m_ticksPerSecond > 0)
+	{
+	    next += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / m_ticksPerSecond));
+	    if(next < Clock::now())
+		next = Clock::now();
+	    else
+		std::this_thread::sleep_until(next);
+	}
     }
-} 
+}
 
-void Graphics::HandleEventOnMouseMotion(const double mousePosX, const double mousePosY)
+bool Graphics::SimulationStep(void)
 {
-    if(m_selectedCircle >= 0)
+    if(m_replay)
     {
-	if(m_editRadius)
+	//several ticks per step, so long insertions can be reviewed quickly;
+	//the cells of all of them are highlighted as newly damaged
+	m_replayDamage.BeginTick();
+	const int speed = m_replaySpeed;
+	for(int k = 0; k < speed; ++k)
 	{
-	    const double cx = m_planner->m_manipSimulator->m_circles[3 * m_selectedCircle];
-	    const double cy = m_planner->m_manipSimulator->m_circles[3 * m_selectedCircle + 1];
-	    
-	    m_planner->m_manipSimulator->m_circles[3 * m_selectedCircle + 2] = sqrt((cx - mousePosX) * (cx - mousePosX) +
-								   (cy - mousePosY) * (cy - mousePosY));
-	}
-	else
-	{
-	    m_planner->m_manipSimulator->m_circles[3 * m_selectedCircle] = mousePosX;
-	    m_planner->m_manipSimulator->m_circles[3 * m_selectedCircle + 1] = mousePosY;
+	    if(!m_reader.Next(m_frame))
+	    {
+		printf("replay: end of log at tick %d\n", m_frame.tick);
+		m_run = false;
+		break;
+	    }
+	    for(int j = 0; j < (int) m_frame.newlyDamaged.size(); ++j)
+		m_replayDamage.MarkDamaged(m_frame.newlyDamaged[j]);
 	}
+	m_planner->m_manipSimulator->SetConfiguration(m_frame.config);
+	m_tick = m_frame.tick;
+	return true;
+    }
+    
+    if(m_planner->m_manipSimulator->HasRobotReachedGoal())
+	return false;
+    
+    m_planner->ConfigurationMove(m_dtheta, m_dx, m_dy);
+    {
+	PROFILE_PHASE(m_planner->GetProfiler(), TICK_PHASE_APPLY_MOVE);
+	m_planner->m_manipSimulator->ApplyMove(m_dtheta, m_dx, m_dy);
+    }
+    PROFILE_END_TICK(m_planner->GetProfiler());
+    m_recorder.Record(*m_planner->m_manipSimulator, m_planner->GetStage(), m_planner->GetDamage());
+    m_tick++;
+    return true;
+}
+
+void Graphics::PublishSnapshot(void)
+{
+    m_snapshots.GetBack().Capture(*m_planner, m_replay ? m_replayDamage : m_planner->GetDamage(), m_tick);
+    m_snapshots.Publish();
+}
+
+void Graphics::StopSimulation(void)
+{
+    m_quit = true;
+    if(m_simThread.joinable())
+	m_simThread.join();
+}
+
+void Graphics::HandleEventOnMouseMotion(const double mousePosX, const double mousePosY)
+{
+    //obstacles can only be edited if this simulator owns them
+    if(m_selectedCircle >= 0 && m_planner->m_manipSimulator->m_ownedAnatomy)
+    {
+	ObstacleSet *obstacles = &m_planner->m_manipSimulator->m_ownedAnatomy->GetObstacles();
+	m_planner->m_manipSimulator->m_ownedAnatomy->ClearNearestWallTable();
+	const double cx = obstacles->GetCenterX(m_selectedCircle);
+	const double cy = obstacles->GetCenterY(m_selectedCircle);
 	
+	if(m_editRadius)
+	    obstacles->SetObstacle(m_selectedCircle, cx, cy, sqrt((cx - mousePosX) * (cx - mousePosX) +
+								  (cy - mousePosY) * (cy - mousePosY)));
+	else
+	    obstacles->SetObstacle(m_selectedCircle, mousePosX, mousePosY, obstacles->GetRadius(m_selectedCircle));
+	m_wallListDirty = true;
     }
     
 }
@@ -126,6 +260,7 @@ void Graphics::HandleEventOnKeyPress(const int key)
     switch(key)
     {
     case 27: //escape key
+	StopSimulation();
 	exit(0);
 	
     case 'r':
@@ -136,6 +271,21 @@ void Graphics::HandleEventOnKeyPress(const int key)
     case 'p':
 	m_run = !m_run;
 	break;
+	
+    case '+':
+    case '=':
+    case '-':
+	if(m_replay)
+	{
+	    m_replaySpeed = key == '-' ? std::max(1, m_replaySpeed / 2) : std::min(4096, 2 * m_replaySpeed);
+	    printf("replay: %d ticks per step\n", (int) m_replaySpeed);
+	}
+	break;
+	
+    case 'b':
+	if(m_replay)
+	    m_rewind = true;
+	break;
     }
    
 }
@@ -143,61 +293,71 @@ void Graphics::HandleEventOnKeyPress(const int key)
 
 void Graphics::HandleEventOnDisplay(void)
 {
+    //all the shapes lie at z = 0, so with the depth test the first one drawn
+    //at a pixel stays on top: the batches keep the order robot, damage,
+    //walls, tip, OCT points
+    const ManipSimulator     *sim      = m_planner->m_manipSimulator;
+    const SimulationSnapshot &snapshot = m_snapshots.GetFront();
+    
 //draw robot
     glColor3f(1, 0, 0);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	
     
-    const int n = m_planner->m_manipSimulator->GetNrLinks();
+    const int n = (int) snapshot.linkX.size() - 1;
     
     glBegin(GL_LINE_STRIP);
-    glVertex2d(m_planner->m_manipSimulator->GetLinkStartX(0), m_planner->m_manipSimulator->GetLinkStartY(0));	
-    for(int j = 0; j < n; ++j)
-	glVertex2d(m_planner->m_manipSimulator->GetLinkEndX(j), m_planner->m_manipSimulator->GetLinkEndY(j));
+    for(int j = 0; j <= n; ++j)
+	glVertex2d(snapshot.linkX[j], snapshot.linkY[j]);
     glEnd();
     
+    m_triangles.clear();
     for(int j = 0; j < n; ++j)
-	DrawCircle2D(m_planner->m_manipSimulator->GetLinkStartX(j), m_planner->m_manipSimulator->GetLinkStartY(j), 0.15);
+	AddCircle2D(m_triangles, snapshot.linkX[j], snapshot.linkY[j], 0.15);
+    DrawTriangles2D(m_triangles);
    
     
-    //display the collision points
-    glColor3f(0,1,0);
-    for(int j=0; j<m_planner->scrapedObstacles.size(); j++)
+    //display the collision points (only the damaged cells, not the whole wall);
+    //the ones scraped during the last tick are highlighted
+    const int nrDamaged = snapshot.damaged.size();
+    for(int pass = 0; pass < 2; ++pass)
     {
-        if(m_planner->scrapedObstacles[j] == false)
-            continue;
-        
-        int i = j;
-        DrawCircle2D(m_planner->m_manipSimulator->GetObstacleCenterX(i), 
-                     m_planner->m_manipSimulator->GetObstacleCenterY(i), 
-                     1*m_planner->m_manipSimulator->GetObstacleRadius(i));
+	if(pass == 0)
+	    glColor3f(0,1,0);
+	else
+	    glColor3f(1,1,1);
+	
+	m_triangles.clear();
+	for(int j = pass == 0 ? 0 : snapshot.nrOldDamaged; j < (pass == 0 ? snapshot.nrOldDamaged : nrDamaged); j++)
+	{
+	    int i = snapshot.damaged[j];
+	    AddCircle2D(m_triangles, sim->GetObstacleCenterX(i), sim->GetObstacleCenterY(i), 1*sim->GetObstacleRadius(i));
+	}
+	DrawTriangles2D(m_triangles);
     }
     
 //draw obstacles
 
     //glColor3f(0, 1, 0);
    // DrawCircle2D(m_planner->m_manipSimulator->GetGoalCenterX(), m_planner->m_manipSimulator->GetGoalCenterY(), m_planner->m_manipSimulator->GetGoalRadius());
+    if(m_wallListDirty)
+	BuildWallList();
     glColor3f(0, 0, 1);
-    for(int i = 0; i < m_planner->m_manipSimulator->GetNrObstacles(); ++i)
-	DrawCircle2D(m_planner->m_manipSimulator->GetObstacleCenterX(i), 
-		     m_planner->m_manipSimulator->GetObstacleCenterY(i), 
-		     m_planner->m_manipSimulator->GetObstacleRadius(i));
+    glCallList(m_wallList);
     
     
     //draw the electrode tip
     glColor3f(1, 1, 0);
-    DrawCircle2D(m_planner->GetElectrodeTip().m_x, 
-                 m_planner->GetElectrodeTip().m_y, 
-                 2*m_planner->m_manipSimulator->GetObstacleRadius(100));
+    DrawCircle2D(snapshot.tipX, snapshot.tipY, 2*sim->GetObstacleRadius(100));
     
     //display the currently sensed OCT points
     glColor3f(1,0,0);
-    for(int j=0; j<m_planner->sensedPoints.size(); j++)
+    m_triangles.clear();
+    for(int j=0; j<(int) snapshot.sensed.size(); j++)
     {
-        int i = m_planner->sensedPoints[j];
-        DrawCircle2D(m_planner->m_manipSimulator->GetObstacleCenterX(i), 
-                     m_planner->m_manipSimulator->GetObstacleCenterY(i), 
-                     2*m_planner->m_manipSimulator->GetObstacleRadius(i));
+        int i = snapshot.sensed[j];
+        AddCircle2D(m_triangles, sim->GetObstacleCenterX(i), sim->GetObstacleCenterY(i), 2*sim->GetObstacleRadius(i));
     }
+    DrawTriangles2D(m_triangles);
 
     
 }
@@ -205,15 +365,53 @@ void Graphics::HandleEventOnDisplay(void)
 
 void Graphics::DrawCircle2D(const double cx, const double cy, const double r)
 {
-    const int    nsides = 50;    
-    const double angle  = 2 * M_PI / nsides;
-    
     glBegin(GL_POLYGON);
-    for(int i = 0; i <= nsides; i++)
-	glVertex2d(cx + r * cos(i * angle), cy + r * sin(i * angle));
+    for(int i = 0; i <= NR_CIRCLE_SIDES; i++)
+	glVertex2d(cx + r * m_unitCircle[2 * i], cy + r * m_unitCircle[2 * i + 1]);
     glEnd();	
 }
 
+void Graphics::AddCircle2D(std::vector<float> &triangles, const double cx, const double cy, const double r) const
+{
+    //a fan around the center, as separate triangles so that any number of
+    //circles go in one draw call
+    for(int i = 0; i < NR_CIRCLE_SIDES; i++)
+    {
+	const float vertices[6] = {(float) cx, (float) cy,
+				   (float) (cx + r * m_unitCircle[2 * i]), (float) (cy + r * m_unitCircle[2 * i + 1]),
+				   (float) (cx + r * m_unitCircle[2 * i + 2]), (float) (cy + r * m_unitCircle[2 * i + 3])};
+	triangles.insert(triangles.end(), vertices, vertices + 6);
+    }
+}
+
+void Graphics::DrawTriangles2D(const std::vector<float> &triangles) const
+{
+    if(triangles.empty())
+	return;
+    
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, &triangles[0]);
+    glDrawArrays(GL_TRIANGLES, 0, triangles.size() / 2);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void Graphics::BuildWallList(void)
+{
+    ManipSimulator *sim = m_planner->m_manipSimulator;
+    
+    m_triangles.clear();
+    for(int i = 0; i < sim->GetNrObstacles(); ++i)
+	AddCircle2D(m_triangles, sim->GetObstacleCenterX(i), sim->GetObstacleCenterY(i), sim->GetObstacleRadius(i));
+    
+    //the vertex array is copied into the list when it is compiled
+    if(m_wallList == 0)
+	m_wallList = glGenLists(1);
+    glNewList(m_wallList, GL_COMPILE);
+    DrawTriangles2D(m_triangles);
+    glEndList();
+    m_wallListDirty = false;
+}
+
 
 void Graphics::CallbackEventOnDisplay(void)
 {
@@ -263,7 +461,6 @@ void Graphics::CallbackEventOnTimer(int id)
 {
     if(m_graphics)
     {
-	m_graphics->HandleEventOnTimer();
 	glutTimerFunc(15, CallbackEventOnTimer, id);
 	glutPostRedisplay();	    
     }
@@ -302,11 +499,31 @@ int main(int argc, char **argv)
     if(argc < 4)
     {
 	printf("missing arguments\n");		
-	printf("  Planner <obstacle file> <nrLinks> <linkLength> \n");
+	printf("  Planner <obstacle file> <nrLinks> <linkLength> [--rrt] [--record <log>] [--replay <log>]\n");
+	printf("          [--sim-rate <ticks per second, 0: as fast as possible>]\n");
 	return 0;		
     }
 
-    Graphics graphics(argv[1], atoi(argv[2]), atof(argv[3]));
+    bool        useRRT = false;
+    const char *record = NULL;
+    const char *replay = NULL;
+    double      rate   = 1000.0 / 15;
+    for(int i = 4; i < argc; ++i)
+    {
+	if(strcmp(argv[i], "--rrt") == 0)
+	    useRRT = true;
+	else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+	    record = argv[++i];
+	else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+	    replay = argv[++i];
+	else if(strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc)
+	    rate = atof(argv[++i]);
+    }
+
+    Graphics graphics(argv[1], atoi(argv[2]), atof(argv[3]), useRRT && replay == NULL);
+    if((record && !graphics.Record(record)) || (replay && !graphics.Replay(replay)))
+	return 1;
+    graphics.SetSimulationRate(rate);
     
     graphics.MainLoop();
     
@@ -9,25 +9,79 @@
 
 #include "ManipPlanner.hpp"
 #include "ManipSimulator.hpp"
+#include "InsertionTrajectory.hpp"
+#include "TrajectoryLog.hpp"
+#include "SimulationSnapshot.hpp"
+#include <thread>
 #include <vector>
 
 class Graphics
 {   
 public:
-    Graphics(const char fname[], const int nrLinks, const double linkLength);
+    Graphics(const char fname[], const int nrLinks, const double linkLength, const bool useRRT = false);
     
     ~Graphics(void);
 
+    /**
+     *@brief Starts the simulation thread and enters the GLUT loop
+     */
     void MainLoop(void);
+    
+    /**
+     *@brief Ticks per second of the simulation thread while running ('p');
+     *       0 runs it as fast as possible. The window is redrawn every 15 ms
+     *       regardless, from the latest snapshot.
+     */
+    void SetSimulationRate(const double ticksPerSecond)
+    {
+	m_ticksPerSecond = ticksPerSecond;
+    }
+    
+    /**
+     *@brief Records every tick of the insertion in a trajectory log
+     */
+    bool Record(const char fname[]);
+    
+    /**
+     *@brief Plays a trajectory log instead of running the planner ('p' plays,
+     *       '+' and '-' change the ticks drawn per frame, 'b' goes back to the
+     *       start); the log must be of this anatomy and electrode
+     */
+    bool Replay(const char fname[]);
 
 protected:
-    void HandleEventOnTimer(void);
+    /**
+     *@brief Runs on the simulation thread: advances the insertion (or the
+     *       replay) and publishes a snapshot after every step
+     */
+    void SimulationLoop(void);
+    
+    /**
+     *@brief One tick of the planner, or m_replaySpeed ticks of the replay;
+     *       false if there was nothing to advance
+     */
+    bool SimulationStep(void);
+    void PublishSnapshot(void);
+    void StopSimulation(void);
+    
     void HandleEventOnDisplay(void);
     void HandleEventOnMouseBtnDown(const int whichBtn, const double mousePosX, const double mousePosY);
     void HandleEventOnMouseMotion(const double mousePosX, const double mousePosY);
     void HandleEventOnKeyPress(const int key);
 
     void DrawCircle2D(const double cx, const double cy, const double r);
+    
+    /**
+     *@brief Appends the triangles of a circle (from the unit-circle table) to a
+     *       batch, drawn later by one DrawTriangles2D call
+     */
+    void AddCircle2D(std::vector<float> &triangles, const double cx, const double cy, const double r) const;
+    void DrawTriangles2D(const std::vector<float> &triangles) const;
+    
+    /**
+     *@brief Compiles the walls into m_wallList (once, and again after an edit)
+     */
+    void BuildWallList(void);
 
     static void CallbackEventOnDisplay(void);
     static void CallbackEventOnMouse(int button, int state, int x, int y);
@@ -37,10 +91,42 @@ protected:
     static void MousePosition(const int x, const int y, double *posX, double *posY);
 
     ManipPlanner   *m_planner;
+    
+    //insertion planned ahead by RRTConnectPlanner (--rrt), replayed by the timer
+    InsertionTrajectory m_trajectory;
+    
+    //trajectory logs: recording of the live run, or replay of a log (the
+    //damage is then taken from the log, in m_replayDamage)
+    TrajectoryWriter m_recorder;
+    TrajectoryReader m_reader;
+    TrajectoryFrame  m_frame;
+    DamageTracker    m_replayDamage;
+    bool             m_replay;
+    std::atomic<int> m_replaySpeed;
+    std::atomic<bool> m_rewind;
+    
+    //the simulator and planner belong to the simulation thread once it has
+    //started; the display only draws the snapshots it publishes
+    std::thread       m_simThread;
+    SnapshotBuffer    m_snapshots;
+    double            m_ticksPerSecond;
+    int               m_tick;
+    std::atomic<bool> m_quit;
+
+    //cos and sin at the NR_CIRCLE_SIDES + 1 corners of the unit circle,
+    //computed once instead of per circle and per frame
+    static const int NR_CIRCLE_SIDES = 50;
+    double m_unitCircle[2 * (NR_CIRCLE_SIDES + 1)];
+    
+    //the walls only change when an obstacle is edited, so they are drawn
+    //from a display list; the overlays are batched per colour every frame
+    unsigned int       m_wallList;
+    bool               m_wallListDirty;
+    std::vector<float> m_triangles;
 
     int  m_selectedCircle;
     bool m_editRadius;
-    bool m_run;
+    std::atomic<bool> m_run;
     
     double m_dtheta;
     double m_dx;
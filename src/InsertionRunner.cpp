@@ -0,0 +1,49 @@
+#include "InsertionRunner.hpp"
+#include <chrono>
+#include <ctime>
+
+InsertionResult RunInsertion(ManipPlanner *planner, ManipSimulator *simulator, const int maxTicks,
+			     FILE *damageLog, FILE *stepLog, TrajectoryWriter *trajectoryLog)
+{
+    InsertionResult result;
+    double dtheta = 0, dx = 0, dy = 0;
+    
+    const clock_t start = clock();
+    const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+    
+    result.ticks = 0;
+    while(!planner->IsFullyInserted() && !simulator->HasRobotReachedGoal() &&
+          (maxTicks <= 0 || result.ticks < maxTicks))
+    {
+        planner->ConfigurationMove(dtheta, dx, dy);
+        {
+            PROFILE_PHASE(planner->GetProfiler(), TICK_PHASE_APPLY_MOVE);
+            simulator->ApplyMove(dtheta, dx, dy);
+        }
+        PROFILE_END_TICK(planner->GetProfiler());
+        result.ticks++;
+        
+        if(damageLog)
+        {
+            const DamageTracker &damage = planner->GetDamage();
+            for(int k = 0; k < damage.GetNrNewlyDamaged(); ++k)
+                fprintf(damageLog, "%d,%d\n", result.ticks, damage.GetNewlyDamaged()[k]);
+        }
+        
+        if(stepLog)
+            fprintf(stepLog, "%d,%d,%g,%g\n", result.ticks, planner->GetStage(),
+                    planner->GetLastStepSize(), planner->GetLastClearance());
+        
+        if(trajectoryLog)
+            trajectoryLog->Record(*simulator, planner->GetStage(), planner->GetDamage());
+    }
+    
+    result.cpuSeconds        = (double)(clock() - start) / CLOCKS_PER_SEC;
+    result.wallSeconds       = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    result.totalCellsDamaged = planner->GetTotalCellsDamaged();
+    result.nrObstacles       = simulator->GetNrObstacles();
+    result.percentDamaged    = result.nrObstacles > 0 ? 100.0 * result.totalCellsDamaged / result.nrObstacles : 0;
+    result.completed         = planner->IsFullyInserted() || simulator->HasRobotReachedGoal();
+    
+    return result;
+}
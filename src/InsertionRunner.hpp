@@ -0,0 +1,44 @@
+/**
+ *@file InsertionRunner.hpp
+ *@brief Headless driver that steps the planner and simulator without GLUT
+ */
+
+#ifndef INSERTION_RUNNER_HPP_
+#define INSERTION_RUNNER_HPP_
+
+#include "ManipPlanner.hpp"
+#include "ManipSimulator.hpp"
+#include "TrajectoryLog.hpp"
+#include <cstdio>
+
+struct InsertionResult
+{
+    int    ticks;
+    int    totalCellsDamaged;
+    int    nrObstacles;
+    double percentDamaged;
+    double cpuSeconds;
+    double wallSeconds;
+    
+    //true if the electrode was fully bent (retractionCoeff == -1) or
+    //reached the goal before maxTicks ran out
+    bool   completed;
+};
+
+/**
+ *@brief Runs ConfigurationMove -> base/theta update -> FK in a tight loop
+ *       until the electrode is fully inserted, the goal is reached or
+ *       maxTicks ticks have been taken (maxTicks <= 0 means no limit)
+ *
+ *@param damageLog if not NULL, one "tick,cell" line is written for every
+ *       wall cell as it gets damaged (from the planner's newly damaged list),
+ *       with ticks counted from the start of this call
+ *@param stepLog if not NULL, one "tick,stage,stepSize,clearance" line is
+ *       written per tick (see ManipPlanner::GetLastStepSize)
+ *@param trajectoryLog if not NULL (and open), every tick is recorded in it
+ */
+InsertionResult RunInsertion(ManipPlanner *planner, ManipSimulator *simulator, const int maxTicks,
+			     FILE *damageLog = NULL, FILE *stepLog = NULL,
+			     TrajectoryWriter *trajectoryLog = NULL);
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ *@file InsertionTrajectory.hpp
+ *@brief Insertion planned ahead of time, as the sequence of planner moves
+ *       that replays it (see ManipPlanner::SetTrajectory)
+ */
+
+#ifndef INSERTION_TRAJECTORY_HPP_
+#define INSERTION_TRAJECTORY_HPP_
+
+#include <vector>
+
+/**
+ * One tick of an insertion, in the form returned by ManipPlanner::ConfigurationMove
+ * and taken by ManipSimulator::ApplyMove
+ */
+struct InsertionMove
+{
+    double deltaTheta;
+    double baseDeltaX;
+    double baseDeltaY;
+};
+
+struct InsertionTrajectory
+{
+    std::vector<InsertionMove> moves;
+};
+
+#endif
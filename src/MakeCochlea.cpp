@@ -0,0 +1,41 @@
+/**
+ *@file MakeCochlea.cpp
+ *@brief Generates a synthetic cochlea wall (replaces utils/make_obstacles.m)
+ */
+
+#include "AnatomyGenerator.hpp"
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+	printf("missing arguments\n");		
+	printf("  MakeCochlea <output file | -> <A> [angleStepDeg] [wallRadius] [turns] \n");
+	printf("  e.g. MakeCochlea bin/cochlea_male_A943.txt 943\n");
+	return 0;		
+    }
+
+    SpiralParameters params;
+    params.scale = atof(argv[2]) / 100;
+    if(argc > 3)
+	params.angleStep = atof(argv[3]) / 180 * M_PI;
+    if(argc > 4)
+	params.wallRadius = atof(argv[4]);
+    if(argc > 5)
+	params.thetaEnd = atof(argv[5]) * 2 * M_PI;
+
+    FILE *out = strcmp(argv[1], "-") == 0 ? stdout : fopen(argv[1], "w");
+    if(out == NULL)
+    {
+	printf("error: cannot write %s\n", argv[1]);
+	return 1;
+    }
+    
+    const bool ok = WriteSpiralWall(params, out);
+    if(out != stdout)
+	fclose(out);
+    
+    return ok ? 0 : 1;
+}
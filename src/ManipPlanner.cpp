@@ -1,44 +1,113 @@
 #include "ManipPlanner.hpp"
 using namespace std;
 
-ManipPlanner::ManipPlanner(ManipSimulator * const manipSimulator)
+PlannerParameters::PlannerParameters(void)
+{
+    //maxmimum imaging depth of our OCT probe
+    maxOCTDepth = 2;
+    
+    //angle bandwidth of OCT probe
+    angleBandwidth = 1.0/36 * M_PI;        //have a sensitivity of +/- 5 deg
+    
+    //repulsive force parameters
+    alpha = 1;
+    gamma = 5;
+    Q = 1;
+    
+    //attractive force parameters
+    beta = 10;
+    
+    //local minimum escape
+    localMinimumBetaFactor  = 1.4;
+    localMinimumAlphaFactor = 0.9;
+    
+    useDistanceField = false;
+    linkCollision    = false;
+    sweptCollision   = false;
+    
+    adaptiveStep = false;
+    stepSafety   = 0.5;
+    minStepScale = 0.5;
+    maxStepScale = 4;
+    sweptStep    = false;
+}
+
+ManipPlanner::ManipPlanner(ManipSimulator * const manipSimulator, const PlannerParameters &params)
 {
     m_manipSimulator = manipSimulator;   
     
     //initialize maxmimum imaging depth of our OCT probe
-    MAX_OCT_DEPTH = 2;
+    MAX_OCT_DEPTH = params.maxOCTDepth;
     
     //initialize angle bandwidth of OCT probe
-    ANGLE_BANDWIDTH = 1.0/36 * M_PI;       //have a sensitivity of +/- 5 deg
+    ANGLE_BANDWIDTH = params.angleBandwidth;
     
     //initialize retraction coefficient to 0 (ie: stylus fully inserted)
     retractionCoeff = 0;
     
     //initialize sensedObstacles, which lets us build our potential field
-    //and scrapedObstacles, which represents which "cells" we've hit
+    //and damage, which represents which "cells" we've hit
     sensedObstacles.clear();
-    scrapedObstacles.clear();
-    totalCellsDamaged = 0;
     for(int i=0; i<m_manipSimulator->GetNrObstacles(); i++)
-    {
         sensedObstacles.push_back(false);
-        scrapedObstacles.push_back(false);
-    }
+    damage.Reset(m_manipSimulator->GetNrObstacles());
     
     //initialize our algorithm to stage 0
     stage = 0;
     
     //initialize repulsive force parameters
-    alpha = 1;
-    gamma = 5;
-    Q = 1;
+    alpha = params.alpha;
+    gamma = params.gamma;
+    Q = params.Q;
+    useDistanceField = params.useDistanceField;
+    linkCollision = params.linkCollision;
+    sweptCollision = params.sweptCollision;
+    
+    //initialize step sizing
+    adaptiveStep = params.adaptiveStep;
+    stepSafety = params.stepSafety;
+    minStepScale = params.minStepScale;
+    maxStepScale = params.maxStepScale;
+    sweptStep = params.sweptStep;
+    lastStepSize = 0;
+    lastContactTime = HUGE_VAL;
+    lastClearance = HUGE_VAL;
     
     //initialize attractive force parameters
-    beta = 10;
+    beta = params.beta;
+    
+    //initialize local minimum escape factors
+    localMinimumBetaFactor  = params.localMinimumBetaFactor;
+    localMinimumAlphaFactor = params.localMinimumAlphaFactor;
+    
+    //reserve the per-tick buffers for the worst case (every obstacle nearby)
+    //so that a steady-state tick never has to grow them
+    int O = m_manipSimulator->GetNrObstacles();
+    sensedPoints.reserve(O);
+    sensedList.reserve(O);
+    sensedX.reserve(O);
+    sensedY.reserve(O);
+    sensedR.reserve(O);
+    nearbyObstacles.reserve(O);
+    octClosestX.reserve(O);
+    octClosestY.reserve(O);
+    octCenterDist.reserve(O);
+    octAngle.reserve(O);
+    octDepth.reserve(O);
+    oct.depth.reserve(O);
+    oct.angle.reserve(O);
+    oct.NrScans = 0;
     
     //intialize other vars
     sensedPoints.clear();
     displayedMessage = false;
+    
+    //serial until a thread pool is given
+    pool = NULL;
+    
+    //follow the potential field until a trajectory is given
+    trajectory = NULL;
+    trajectoryTick = 0;
 }
 
 ManipPlanner::~ManipPlanner(void)
@@ -46,6 +115,25 @@ ManipPlanner::~ManipPlanner(void)
     //do not delete m_simulator  
 }
 
+/**
+ * Spreads the obstacle loops of every tick over the threads of the pool
+ * (NULL goes back to serial). The results are the same either way.
+ */
+void ManipPlanner::SetThreadPool(ThreadPool *threadPool)
+{
+    pool = threadPool;
+}
+
+/**
+ * Plays the given trajectory from its first move on the next calls to
+ * ConfigurationMove (NULL goes back to the potential field).
+ */
+void ManipPlanner::SetTrajectory(const InsertionTrajectory *planned)
+{
+    trajectory = planned;
+    trajectoryTick = 0;
+}
+
 /**
  * This is the main function (and only public function in the class) which run our
  * algorithm for determining how to move the cochlea.
@@ -55,6 +143,12 @@ ManipPlanner::~ManipPlanner(void)
  */
 void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, double &baseDeltaY)
 {
+    PROFILE_PHASE(&profiler, TICK_PHASE_TICK);
+    
+    //nothing has been scraped yet during this tick
+    damage.BeginTick();
+    lastStepSize = 0;
+    
     //check if we're done
     if(retractionCoeff == -1)   //FULLY BENT, we're done
     {
@@ -71,22 +165,68 @@ void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, dou
         {
             //display total damage done
             cout << "ELECTRODE INSERTED." << endl;
-            cout << "TOTAL CELLS DAMAGED: " << totalCellsDamaged << " " << endl;
-            printf("PERCENT OF CELLS DAMAGED: %.2f%%\n\n", 100.0 * totalCellsDamaged / m_manipSimulator->GetNrObstacles());
+            cout << "TOTAL CELLS DAMAGED: " << damage.GetNrDamaged() << " " << endl;
+            printf("PERCENT OF CELLS DAMAGED: %.2f%%\n\n", 100.0 * damage.GetNrDamaged() / m_manipSimulator->GetNrObstacles());
             displayedMessage = true;
         }
         return;
     }
     
+    //make sure the force workspaces fit the electrode (only allocates on the first tick)
+    ReserveWorkspace(m_manipSimulator->GetNrLinks());
+    
     //get OCT data and update cochlea display with "OCT sensing"
-    OCTData oct = ScanOCT();
+    {
+        PROFILE_PHASE(&profiler, TICK_PHASE_OCT_SCAN);
+        ScanOCT(oct);
+    }
 
     //check for "scraping" the cochlear walls
-    CollisionChecker();
+    {
+        PROFILE_PHASE(&profiler, TICK_PHASE_COLLISION_CHECK);
+        CollisionChecker();
+    }
     
     //update retraction coefficient
     retractionCoeff = m_manipSimulator->GetCurrentLink();
     
+    //replaying a planned trajectory: the sensing and damage counting above
+    //are the same, only the move does not come from the potential field
+    if(trajectory)
+    {
+        deltaTheta = 0;
+        baseDeltaX = 0;
+        baseDeltaY = 0;
+        if(trajectoryTick < (int)trajectory->moves.size())
+        {
+            const InsertionMove &move = trajectory->moves[trajectoryTick++];
+            deltaTheta = move.deltaTheta;
+            baseDeltaX = move.baseDeltaX;
+            baseDeltaY = move.baseDeltaY;
+        }
+        lastStepSize = StepReach(baseDeltaX, baseDeltaY, deltaTheta, GetElectrodeLength());
+        return;
+    }
+    
+    //in adaptive stepping mode, the step caps scale with the distance to the
+    //sensed walls (stage 0 creeps forward, stage 1 translates and bends)
+    double creepScale = 1, moveScale = 1;
+    if(adaptiveStep)
+    {
+        double length = GetElectrodeLength();
+        lastClearance = SensedClearance();
+        creepScale = AdaptiveStepScale(lastClearance, StepReach(CREEP_STEP, 0, 0, length), stepSafety, minStepScale, maxStepScale);
+        moveScale = AdaptiveStepScale(lastClearance, StepReach(BASE_STEP, BASE_STEP, THETA_STEP, length), stepSafety, minStepScale, maxStepScale);
+    }
+    
+    //in swept stepping mode, plan the largest step and cut it at the first contact
+    //(unless the adaptive scale already sized it)
+    if(sweptStep && !adaptiveStep)
+    {
+        creepScale = maxStepScale;
+        moveScale = maxStepScale;
+    }
+    
     
     switch(stage)
     {
@@ -113,7 +253,7 @@ void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, dou
             //okay nothing in front of us
             //keep moving in the +x direction
             deltaTheta = 0;
-            baseDeltaX = 0.03;
+            baseDeltaX = CREEP_STEP * creepScale;
             baseDeltaY = 0;
             break;
         }
@@ -131,14 +271,50 @@ void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, dou
             //we've sensed some obstacles in our trajectory so far.
             //let's use them to build a repulsive potential field
             int L = m_manipSimulator->GetNrLinks();
-            for (int i=0; i<L; i++)
+            double* csf = &linkCSF[0];
+            
             {
-                double* csf = RepulsiveCSFAtLink(i);
+                //the Jacobians only depend on the configuration, so build them
+                //once for all the obstacles and for the attractive force
+                PROFILE_PHASE(&profiler, TICK_PHASE_REPULSIVE_FIELD);
+                BuildJacobians();
+            
+                //with a thread pool, the links get their forces concurrently (each
+                //one into its own row), and the rows are added up in link order
+                bool parallelLinks = pool && (int)sensedList.size() * L >= PARALLEL_GRAIN;
+                if(parallelLinks)
+                    pool->ParallelFor(L, [this](int i) { RepulsiveCSFAtLink(i, &linkCSFRows[i * linkCSF.size()]); });
+            
+                for (int i=0; i<L; i++)
+                {
+                    if(parallelLinks)
+                        csf = &linkCSFRows[i*(L+2)];
+                    else
+                        RepulsiveCSFAtLink(i, csf);
+                
+                    //the first two values of csf are going to be added to delta x, y
+                    baseDeltaX += csf[0];
+                    baseDeltaY += csf[1];
                 
+                    //the delta theta should be the sum of all the other thetas
+                    for(int k=2; k<L+2; k++)
+                    {
+                        deltaTheta += csf[k];
+                    }
+                }
+            
+            }
+            
+            {
+                //now get the attractive force and add it on
+                PROFILE_PHASE(&profiler, TICK_PHASE_ATTRACTIVE_FIELD);
+                csf = &linkCSF[0];
+                WSF2CSF(AttractiveForce(), L-1, csf);
+            
                 //the first two values of csf are going to be added to delta x, y
                 baseDeltaX += csf[0];
                 baseDeltaY += csf[1];
-                
+            
                 //the delta theta should be the sum of all the other thetas
                 for(int k=2; k<L+2; k++)
                 {
@@ -146,33 +322,23 @@ void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, dou
                 }
             }
             
-            //now get the attractive force and add it on
-            double* csf = WSF2CSF(AttractiveForce(), L-1);
-            
-            //the first two values of csf are going to be added to delta x, y
-            baseDeltaX += csf[0];
-            baseDeltaY += csf[1];
-            
-            //the delta theta should be the sum of all the other thetas
-            for(int k=2; k<L+2; k++)
             {
-                deltaTheta += csf[k];
-            }
-            
-            
-            while(abs(baseDeltaX) > 0.05)
-            {
-                baseDeltaX /= 2;
-                baseDeltaY /= 2;
-            }
-            while(abs(baseDeltaY) > 0.05)
-            {
-                baseDeltaX /= 2;
-                baseDeltaY /= 2;
-            }
-            while(abs(deltaTheta) > 0.03)
-            {
-                deltaTheta /= 2;
+                //keep the move within the step caps
+                PROFILE_PHASE(&profiler, TICK_PHASE_STEP_CLAMP);
+                while(abs(baseDeltaX) > BASE_STEP * moveScale)
+                {
+                    baseDeltaX /= 2;
+                    baseDeltaY /= 2;
+                }
+                while(abs(baseDeltaY) > BASE_STEP * moveScale)
+                {
+                    baseDeltaX /= 2;
+                    baseDeltaY /= 2;
+                }
+                while(abs(deltaTheta) > THETA_STEP * moveScale)
+                {
+                    deltaTheta /= 2;
+                }
             }
             
             //check to see if we're out of the cochlea (shouldn't happen, but
@@ -199,10 +365,10 @@ void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, dou
             cout << "IN LOCAL MINIMUM" << endl;
             
             //increase attractive force
-            beta *= 1.4;
+            beta *= localMinimumBetaFactor;
             
             //reduce repulsive force
-            alpha *= 0.9;
+            alpha *= localMinimumAlphaFactor;
             
             //go back to stage 1
             stage = 1;
@@ -216,6 +382,69 @@ void ManipPlanner::ConfigurationMove(double &deltaTheta, double &baseDeltaX, dou
             break;
         }
     }
+    
+    if(sweptStep)
+        ClipMoveAtFirstContact(deltaTheta, baseDeltaX, baseDeltaY);
+    
+    //record how far this move can take the electrode
+    lastStepSize = StepReach(baseDeltaX, baseDeltaY, deltaTheta, GetElectrodeLength());
+}
+
+/**
+ * Smallest distance from any link to the surface of a sensed obstacle
+ * (HUGE_VAL if nothing has been sensed yet).
+ */
+double ManipPlanner::SensedClearance(void)
+{
+    int L = m_manipSimulator->GetNrLinks();
+    int S = sensedList.size();
+    double clearance = HUGE_VAL;
+    
+    for(int j=0; j<L && S > 0; j++)
+        clearance = SegmentClearance(m_manipSimulator->GetLinkStartX(j), m_manipSimulator->GetLinkStartY(j),
+                                     m_manipSimulator->GetLinkEndX(j), m_manipSimulator->GetLinkEndY(j),
+                                     &sensedX[0], &sensedY[0], &sensedR[0], S, clearance);
+    
+    return clearance;
+}
+
+/**
+ * Shortens the move to stepSafety times the point where the electrode would
+ * first come into contact with a sensed wall (a swept check, so no wall is
+ * skipped however long the move), keeping at least minStepScale / maxStepScale
+ * of it so the electrode does not stop once in contact.
+ */
+void ManipPlanner::ClipMoveAtFirstContact(double &deltaTheta, double &baseDeltaX, double &baseDeltaY)
+{
+    lastContactTime = HUGE_VAL;
+    
+    int S = sensedList.size();
+    if(S == 0 || (deltaTheta == 0 && baseDeltaX == 0 && baseDeltaY == 0))
+        return;
+    
+    m_manipSimulator->GetConfiguration(sweepFrom);
+    m_manipSimulator->GetConfigurationAfterMove(deltaTheta, baseDeltaX, baseDeltaY, sweepTo);
+    sweep.SetWalls(&sensedX[0], &sensedY[0], &sensedR[0], S);
+    lastContactTime = sweep.TimeOfFirstContact(m_manipSimulator->GetLinkLengths(), sweepFrom, sweepTo, CONTACT_DISTANCE);
+    
+    if(lastContactTime < 1)
+    {
+        double s = max(stepSafety * lastContactTime, minStepScale / maxStepScale);
+        deltaTheta *= s;
+        baseDeltaX *= s;
+        baseDeltaY *= s;
+    }
+}
+
+/**
+ * Total length of the links
+ */
+double ManipPlanner::GetElectrodeLength(void)
+{
+    double length = 0;
+    for(int j=0; j<m_manipSimulator->GetNrLinks(); j++)
+        length += m_manipSimulator->GetLinkLength(j);
+    return length;
 }
 
 
@@ -283,6 +512,37 @@ double ManipPlanner::DistanceBetweenPoints(Point a, Point b)
     
 }
 
+/**
+ * Sizes the per-planner force workspaces for L links. This only allocates
+ * the first time (or when the number of links changes), so steady-state
+ * ticks of ConfigurationMove do not touch the heap.
+ */
+void ManipPlanner::ReserveWorkspace(int L)
+{
+    if((int)linkCSF.size() == L+2)
+        return;
+    
+    linkCSF.resize(L+2);
+    jacobianX.resize(L*(L+2));
+    jacobianY.resize(L*(L+2));
+    linkCSFRows.resize(L*(L+2));
+    
+    //one collision point per joint and the tip
+    collisionIds.resize(L+1);
+    collisionHits.resize(L+1);
+    for(int j=0; j<=L; j++)
+    {
+        collisionIds[j].reserve(m_manipSimulator->GetNrObstacles());
+        collisionHits[j].reserve(m_manipSimulator->GetNrObstacles());
+    }
+    
+    //swept collision and swept stepping buffers
+    sweep.Reserve(L, m_manipSimulator->GetNrObstacles());
+    sweepFrom.joints.reserve(L);
+    sweepTo.joints.reserve(L);
+    previousConfiguration.joints.reserve(L);
+}
+
 /**
 * This method mimics an "OCT sweep" around the electrode. In effect,
 * it will provide depth and angle information for all objects that can
@@ -290,11 +550,12 @@ double ManipPlanner::DistanceBetweenPoints(Point a, Point b)
 * It returns an OCTData struct consisting of all the points on obstacles
 * that can be detected.
 */
-OCTData ManipPlanner::ScanOCT(void)
+void ManipPlanner::ScanOCT(OCTData &data)
 {
-    //initialize vars
-    OCTData data;
+    //initialize vars (clearing keeps the capacity, so no allocations here)
     data.NrScans = 0;
+    data.depth.clear();
+    data.angle.clear();
     sensedPoints.clear();
     
     //get the electrode tip position
@@ -305,13 +566,76 @@ OCTData ManipPlanner::ScanOCT(void)
     //since the cochlea tissue is made up of lots and lots of tiny 
     //circular obstacles, we can basically get the closest point to all of
     //them, ignoring any whose closest point is greater than MAX_OCT_DEPTH
-    int NrObs = m_manipSimulator->GetNrObstacles();
+    //(only the obstacles around the tip can be that close)
+    m_manipSimulator->GetObstaclesNear(ex, ey, MAX_OCT_DEPTH, nearbyObstacles);
+    
+    int NrNear = nearbyObstacles.size();
+    octClosestX.resize(NrNear);
+    octClosestY.resize(NrNear);
+    octCenterDist.resize(NrNear);
+    octAngle.resize(NrNear);
+    octDepth.resize(NrNear);
+    
+    //angle of our last link (the same for every obstacle we look at)
+    octTip = e;
+    octTipAngle = GetAngleFromXAxis(m_manipSimulator->GetNrLinks()-1);
     
-    for(int i=0;i<NrObs;i++)
+    //classify the obstacles (independently of each other, so ranges of them
+    //can be done on different threads)
+    int nrChunks = (NrNear + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+    if(pool && nrChunks > 1)
+        pool->ParallelFor(nrChunks, [this](int c) { ClassifyOCTRange(c * PARALLEL_GRAIN, min((c + 1) * PARALLEL_GRAIN, (int)nearbyObstacles.size())); });
+    else
+        ClassifyOCTRange(0, NrNear);
+    
+    //then collect what was seen, in order
+    for(int k=0;k<NrNear;k++)
     {
-        //find the closest point to this obstacle, incorporating OCT depth
-        Point p = m_manipSimulator->ClosestPointOnObstacleAtMaxDist(i, ex, ey, MAX_OCT_DEPTH);
+        if(octAngle[k] == OCT_NOT_SEEN)
+            continue;
+        
+        int i = nearbyObstacles[k];
         
+        //add it to the OCTData
+        data.NrScans++;
+        data.depth.push_back(octDepth[k]);
+        data.angle.push_back(octAngle[k]);
+        
+        //add to sensedPoints for debugging
+        sensedPoints.push_back(i);
+        
+        //add to our sensedObstacles data, to build our potential field
+        if(!sensedObstacles[i])
+        {
+            sensedObstacles[i] = true;
+            AddSensedObstacle(i);
+        }
+    }
+}
+
+/**
+ * OCT classification of nearbyObstacles[begin, end): octAngle[k] is 0 if
+ * obstacle k is seen in front of the tip, -1 to the left, +1 to the right and
+ * OCT_NOT_SEEN otherwise; octDepth[k] is its depth if it is seen.
+ */
+void ManipPlanner::ClassifyOCTRange(int begin, int end)
+{
+    if(begin >= end)
+        return;
+    
+    Point e = octTip;
+    
+    //find the closest point to each of these obstacles in one batch, incorporating OCT depth
+    m_manipSimulator->GetObstacles().ClosestPointsAtMaxDist(e.m_x, e.m_y, MAX_OCT_DEPTH, &nearbyObstacles[begin], end - begin,
+                                                             &octClosestX[begin], &octClosestY[begin], &octCenterDist[begin]);
+    
+    for(int k=begin;k<end;k++)
+    {
+        octAngle[k] = OCT_NOT_SEEN;
+        
+        Point p;
+        p.m_x = octClosestX[k];
+        p.m_y = octClosestY[k];
         
         //check to see if it's within our sensing depth
         if(p.m_x < 0.5*HUGE_VAL && p.m_y < 0.5*HUGE_VAL)
@@ -323,33 +647,23 @@ OCTData ManipPlanner::ScanOCT(void)
             //our link (within a margin ANGLE_BANDWIDTH).
             
             //angle w.r.t. our link
-            double phi = GetAngleToPoint(p) - GetAngleFromXAxis(m_manipSimulator->GetNrLinks()-1);
+            double phi = GetAngleToPoint(p) - octTipAngle;
                         
             if(fabs(phi) < ANGLE_BANDWIDTH || fabs(phi-0.5*M_PI) < ANGLE_BANDWIDTH || fabs(phi-1.5*M_PI) < ANGLE_BANDWIDTH || fabs(phi+0.5*M_PI) < ANGLE_BANDWIDTH)  //it's directy in front of us OR orthogonal to our link
             {
-                //add it to the OCTData
-                data.NrScans++;
-                data.depth.push_back(DistanceBetweenPoints(e, p));
+                octDepth[k] = DistanceBetweenPoints(e, p);
                 
-                //if we're in "front", push a 0 as the angle
-                //if we're to the side, push -1 for "left", +1 for "right"
+                //if we're in "front", 0 is the angle
+                //if we're to the side, -1 for "left", +1 for "right"
                 if(fabs(phi) < ANGLE_BANDWIDTH)
-                    data.angle.push_back(0);
+                    octAngle[k] = 0;
                 else if(fabs(phi-0.5*M_PI) < ANGLE_BANDWIDTH)
-                    data.angle.push_back(-1);
+                    octAngle[k] = -1;
                 else
-                    data.angle.push_back(1);
-                
-                //add to sensedPoints for debugging
-                sensedPoints.push_back(i);
-
-                //add to our sensedObstacles data, to build our potential field
-                sensedObstacles[i] = true;
+                    octAngle[k] = 1;
             }
         }
     }
-    
-    return data;
 }
 
 /**
@@ -358,13 +672,8 @@ OCTData ManipPlanner::ScanOCT(void)
 */
 double ManipPlanner::GetAngleFromXAxis(const int j)
 {
-    double angle = 0;   //will hold the sum of all joint angles up to i
-    
-    //sum over all joint angles
-    for(int i=0; i<=j; i++)
-    {
-        angle += m_manipSimulator->GetLinkTheta(i);
-    }
+    //the simulator caches the sum of all joint angles up to j during FK
+    double angle = m_manipSimulator->GetLinkAbsoluteAngle(j);
     
     //angle will always be negative
     
@@ -379,9 +688,26 @@ double ManipPlanner::GetAngleFromXAxis(const int j)
 
 
 /**
- * This function calculates the configuration space force at link j.
+ * Appends obstacle i (just sensed for the first time) to the dense list of
+ * sensed obstacles, together with a packed copy of its coordinates.
+ */
+void ManipPlanner::AddSensedObstacle(int i)
+{
+    sensedList.push_back(i);
+    sensedX.push_back(m_manipSimulator->GetObstacles().GetCenterX(i));
+    sensedY.push_back(m_manipSimulator->GetObstacles().GetCenterY(i));
+    sensedR.push_back(m_manipSimulator->GetObstacles().GetRadius(i));
+}
+
+/**
+ * This function calculates the configuration space force at link j and
+ * writes it into totalCSF (#links + 2 values).
+ *
+ * Since csf = jac_transpose * wsf is linear in the workspace force, we add up
+ * the workspace forces from all the obstacles first and only map the sum
+ * through the (cached) Jacobian of link j once.
  */
-double* ManipPlanner::RepulsiveCSFAtLink(int j)
+void ManipPlanner::RepulsiveCSFAtLink(int j, double totalCSF[])
 {
     //get the endpoints of link j
     double px = m_manipSimulator->GetLinkEndX(j);
@@ -390,45 +716,89 @@ double* ManipPlanner::RepulsiveCSFAtLink(int j)
     p.m_x = px;
     p.m_y = py;
     
-    //get the number of links
-    int N = m_manipSimulator->GetNrLinks();
-    
-    //get number of obstacles
-    int O = m_manipSimulator->GetNrObstacles();
-    
-    //initialize config space force variable
-    double* totalCSF = new double[N+2];
-    
-    for(int k=0; k<N+2; k++)
+    //in distance-field mode, a single lookup gives the force from the
+    //closest wall, whatever the number of obstacles
+    const DistanceField *field = m_manipSimulator->GetAnatomy()->GetDistanceField();
+    if(useDistanceField && field)
     {
-        totalCSF[k] = 0;
+        WSF2CSF(RepulsiveForceFromDistanceField(field, p), j, totalCSF);
+        return;
     }
     
+    //initialize total workspace force variable
+    Point totalForce;
+    totalForce.m_x = 0;
+    totalForce.m_y = 0;
     
-    for(int i=0; i<O; i++)
+    //we can only get force from obstacles we've detected before, so only
+    //go through the (packed) list of sensed obstacles; none of them can push
+    //on p if the nearest-wall table says every wall is farther than Q
+    int S = sensedList.size();
+    const NearestWallTable *nearestWall = m_manipSimulator->GetAnatomy()->GetNearestWallTable();
+    if(nearestWall && nearestWall->GetDistanceLowerBound(px, py) > Q * (1 + 1e-9))
+        S = 0;
+    for(int n=0; n<S; n++)
     {
-        //we can only get force from this obstacle if we've detected it 
-        //before
-        if(sensedObstacles[i] == false)
-        {
-            //we have not encountered it before
+        double cx = sensedX[n];
+        double cy = sensedY[n];
+        double r  = sensedR[n];
+        
+        //obstacles whose surface is farther than Q do not push on p
+        //(slightly conservative, the exact test is in the force computation)
+        double dcx = cx - px;
+        double dcy = cy - py;
+        double reach = (Q + r) * (1 + 1e-9);
+        if(dcx * dcx + dcy * dcy > reach * reach)
             continue;
-        }
-        //get the force acting on link j from obstacle i
-        Point force = RepulsiveForceAtPointFromObstacle(p, i);
         
-        //convert the workspace force into a cspace force
-        //IMPLEMENT THIS
-        double* csfI = WSF2CSF(force, j);
+        //closest point on the obstacle, as in ManipSimulator::ClosestPointOnObstacle
+        double d = sqrt((cx - px) * (cx - px) + (cy - py) * (cy - py));
+        Point o;
+        o.m_x = cx + r * (px - cx) / d;
+        o.m_y = cy + r * (py - cy) / d;
         
-        //add to the total force
-        for(int k=0; k<N+2; k++)
-        {
-            totalCSF[k] -= csfI[k];
-        }
+        //get the force acting on link j from this obstacle
+        Point force = RepulsiveForceAtPointFromClosestPoint(p, o);
+        
+        //add to the total force (the gradient points toward the obstacle,
+        //so the repulsion is its negative)
+        totalForce.m_x -= force.m_x;
+        totalForce.m_y -= force.m_y;
     }
     
-    return totalCSF;
+    //convert the workspace force into a cspace force
+    WSF2CSF(totalForce, j, totalCSF);
+}
+
+/**
+ * This function calculates the repulsive force at point p from the closest
+ * wall, using the signed distance d and its gradient from the distance field.
+ * It is the same exponential potential as RepulsiveForceAtPointFromObstacle:
+ * there, [pt - obs] = d * gradient, so the repulsion is
+ * gamma * exp(-alpha * d) * (1/d + alpha) * gradient (for d <= Q).
+ */
+Point ManipPlanner::RepulsiveForceFromDistanceField(const DistanceField *field, Point p)
+{
+    double gx, gy;
+    double d = field->Sample(p.m_x, p.m_y, gx, gy);
+    
+    Point force;
+    force.m_x = 0;
+    force.m_y = 0;
+    if(d > Q)
+        return force;
+    
+    //inside (or touching) the wall: keep pushing out with the largest force
+    //the interpolated field can represent instead of blowing up at d = 0
+    const double minDist = 1e-3;
+    if(d < minDist)
+        d = minDist;
+    
+    double forceScale = gamma * exp(-alpha * d) * (1/d + alpha);
+    force.m_x = gx * forceScale;
+    force.m_y = gy * forceScale;
+    
+    return force;
 }
 
 /**
@@ -444,8 +814,19 @@ Point ManipPlanner::RepulsiveForceAtPointFromObstacle(Point p, int i)
     double y = p.m_y;
     
     //get the obstacle closest point
-    double ox = m_manipSimulator->ClosestPointOnObstacle(i, x, y).m_x;
-    double oy = m_manipSimulator->ClosestPointOnObstacle(i, x, y).m_y;
+    return RepulsiveForceAtPointFromClosestPoint(p, m_manipSimulator->ClosestPointOnObstacle(i, x, y));
+}
+
+/**
+ * This function calculates the repulsive force a point p feels from an obstacle
+ * whose closest point to p is o.
+ */
+Point ManipPlanner::RepulsiveForceAtPointFromClosestPoint(Point p, Point o)
+{
+    double x = p.m_x;
+    double y = p.m_y;
+    double ox = o.m_x;
+    double oy = o.m_y;
     
     //get distance to obstacle
     double d = sqrt(pow(ox-x,2) + pow(oy-y,2));
@@ -482,10 +863,10 @@ Point ManipPlanner::RepulsiveForceAtPointFromObstacle(Point p, int i)
 }
 
 /**
- * This function converts the workspace force (given by Point force) for link
- * j into a config space force and returns that.
+ * This function computes the Jacobian of the endpoint of link j and stores
+ * it as row j of the planner's Jacobian workspace.
  */
-double* ManipPlanner::WSF2CSF(Point force, int j)
+void ManipPlanner::BuildJacobian(int j)
 {
     //get the number of links
     int N = m_manipSimulator->GetNrLinks();
@@ -497,8 +878,8 @@ double* ManipPlanner::WSF2CSF(Point force, int j)
     //prepare the Jacobian matrix
     //Jacobian is a 2 x (#links + 2) matrix
     //use 2 row vectors cuz 2D arrays are not fun :(
-    double* jacX = new double[N+2];
-    double* jacY = new double[N+2];
+    double* jacX = &jacobianX[j*(N+2)];
+    double* jacY = &jacobianY[j*(N+2)];
     
     //for the first two columns of the Jac, we are dealing with base parameters
     jacX[0] = 1;
@@ -519,12 +900,36 @@ double* ManipPlanner::WSF2CSF(Point force, int j)
         jacX[i] = (-1*jy+py) * CanLinkBend(i-2);
         jacY[i] = (jx-px) *CanLinkBend(i-2);
     }
+}
+
+/**
+ * Builds the Jacobians of all link endpoints for the current configuration.
+ * This is done once per tick; the repulsive and attractive forces then reuse them.
+ */
+void ManipPlanner::BuildJacobians(void)
+{
+    for(int j=0; j<m_manipSimulator->GetNrLinks(); j++)
+    {
+        BuildJacobian(j);
+    }
+}
+
+/**
+ * This function converts the workspace force (given by Point force) for link
+ * j into a config space force and writes it into csf (#links + 2 values).
+ * It uses the Jacobian of link j built by BuildJacobians for this tick.
+ */
+void ManipPlanner::WSF2CSF(Point force, int j, double csf[])
+{
+    //get the number of links
+    int N = m_manipSimulator->GetNrLinks();
+    
+    const double* jacX = &jacobianX[j*(N+2)];
+    const double* jacY = &jacobianY[j*(N+2)];
     
     //now, calculate the CSF from the WST
     //csf = jac_transpose * wsf
     
-    double* csf = new double[N+2];
-    
     double fx = force.m_x;
     double fy = force.m_y;
     
@@ -532,8 +937,6 @@ double* ManipPlanner::WSF2CSF(Point force, int j)
     {
         csf[i] = jacX[i]*fx + jacY[i]*fy;
     }
-    
-    return csf;
 }
 
 /**
@@ -562,56 +965,136 @@ Point ManipPlanner::AttractiveForce()
 }
 
 /**
- * This function checks to see if the electrode is colliding with any of the
- * cochlear wall cells. We use this to observe the "damage" we've caused to 
- * the cochlea during insertion.
+ * Finds the wall cells that collision point j scrapes: the start of link j
+ * (the electrode tip for j = #links) or, in link collision mode, any point of
+ * link j. A cell is scraped when the point comes within 0.1 of its surface.
+ * Only the obstacles whose center is within 0.1 + the largest radius of the
+ * point (or link segment) are tested, and cells damaged before this tick are
+ * skipped. The cells found are left in collisionIds[j] (with collisionHits[j]
+ * set for the scraped ones); nothing is marked here, so the points can be
+ * checked concurrently.
  */
-void ManipPlanner::CollisionChecker()
+void ManipPlanner::FindCollisions(int j)
 {
-    //go through each of the link joints and see if it's in collision with any
-    //of the obstacles
+    int L = m_manipSimulator->GetNrLinks();
+    const double reach = 0.1 + m_manipSimulator->GetMaxObstacleRadius();
     
-    //go through all the obstacles and only check ones we haven't collided with
-    //before
-    int O = m_manipSimulator->GetNrObstacles();
-
-    totalCellsDamaged = 0;
+    //with a nearest-wall table, points clear of every wall skip the query
+    const NearestWallTable *nearestWall = m_manipSimulator->GetAnatomy()->GetNearestWallTable();
     
-    for(int i=0; i<O; i++)
+    vector<int> &ids = collisionIds[j];
+    vector<char> &hits = collisionHits[j];
+    ids.clear();
+    hits.clear();
+    
+    if(linkCollision)
     {
-        //if we've already collided before, continue
-        if(scrapedObstacles[i] == true)
-        {
-            totalCellsDamaged++;
-            continue;
-        }
+        const ObstacleSet &obstacles = m_manipSimulator->GetObstacles();
+        double ax = m_manipSimulator->GetLinkStartX(j);
+        double ay = m_manipSimulator->GetLinkStartY(j);
+        double bx = m_manipSimulator->GetLinkEndX(j);
+        double by = m_manipSimulator->GetLinkEndY(j);
         
-        //check to see if any of our link points is in collision
-        for(int j=0; j<m_manipSimulator->GetNrLinks(); j++)
+        //every point of the link is within half its length of the middle
+        if(nearestWall)
         {
-            double jx = m_manipSimulator->GetLinkStartX(j);
-            double jy = m_manipSimulator->GetLinkStartY(j);
-            
-            Point j;
-            j.m_x = jx;
-            j.m_y = jy;
-            
-            if(DistanceBetweenPoints(j, m_manipSimulator->ClosestPointOnObstacle(i, jx, jy)) < 0.1)
-            {
-                scrapedObstacles[i] = true;
-                totalCellsDamaged++;
-                break;
-            }
+            double halfLength = 0.5 * sqrt((bx - ax) * (bx - ax) + (by - ay) * (by - ay));
+            if(nearestWall->GetDistanceLowerBound(0.5 * (ax + bx), 0.5 * (ay + by)) - halfLength > 0.1 + 1e-9)
+                return;
         }
         
-        //check for the electrode tip too
-        Point e = GetElectrodeTip();
-        if(!scrapedObstacles[i] &&  DistanceBetweenPoints(e, m_manipSimulator->ClosestPointOnObstacle(i, e.m_x, e.m_y)) < 0.1)
+        m_manipSimulator->GetAnatomy()->GetGrid().GetObstaclesNearSegment(ax, ay, bx, by, reach, ids);
+        
+        for(int k=0; k<(int)ids.size(); k++)
         {
-            scrapedObstacles[i] = true;
-            totalCellsDamaged++;
+            int i = ids[k];
+            double d = sqrt(SquaredDistanceToSegment(ax, ay, bx, by, obstacles.GetCenterX(i), obstacles.GetCenterY(i)));
+            hits.push_back(!damage.IsDamaged(i) && d - obstacles.GetRadius(i) < 0.1);
         }
+        return;
+    }
+    
+    Point pj;
+    if(j < L)
+    {
+        pj.m_x = m_manipSimulator->GetLinkStartX(j);
+        pj.m_y = m_manipSimulator->GetLinkStartY(j);
+    }
+    else
+    {
+        //check for the electrode tip too
+        pj = GetElectrodeTip();
+    }
+    
+    if(nearestWall && nearestWall->GetDistanceLowerBound(pj.m_x, pj.m_y) > 0.1 + 1e-9)
+        return;
+    
+    m_manipSimulator->GetObstaclesNear(pj.m_x, pj.m_y, reach, ids);
+    
+    for(int k=0; k<(int)ids.size(); k++)
+    {
+        int i = ids[k];
+        
+        //if we've already collided before, it's already counted
+        hits.push_back(!damage.IsDamaged(i) &&
+                       DistanceBetweenPoints(pj, m_manipSimulator->ClosestPointOnObstacle(i, pj.m_x, pj.m_y)) < 0.1);
+    }
+}
+
+/**
+ * Marks the cells that FindCollisions(j) found scraped, in the order it found them.
+ */
+void ManipPlanner::MarkCollisions(int j)
+{
+    const vector<int> &ids = collisionIds[j];
+    const vector<char> &hits = collisionHits[j];
+    for(int k=0; k<(int)ids.size(); k++)
+        if(hits[k])
+            damage.MarkDamaged(ids[k]);
+}
+
+/**
+ * This function checks to see if the electrode is colliding with any of the
+ * cochlear wall cells. We use this to observe the "damage" we've caused to 
+ * the cochlea during insertion.
+ */
+void ManipPlanner::CollisionChecker()
+{
+    int L = m_manipSimulator->GetNrLinks();
+    
+    if(sweptCollision)
+    {
+        //sweep from where the electrode was at the last check (on the first
+        //tick there is no motion to sweep, only the current configuration)
+        m_manipSimulator->GetConfiguration(sweepTo);
+        if(previousConfiguration.joints.empty())
+            previousConfiguration = sweepTo;
         
+        sweep.MarkContacts(m_manipSimulator->GetLinkLengths(), previousConfiguration, sweepTo,
+                           m_manipSimulator->GetObstacles(), m_manipSimulator->GetAnatomy()->GetGrid(),
+                           CONTACT_DISTANCE, damage);
+        previousConfiguration = sweepTo;
+        return;
+    }
+    
+    //go through each of the link joints and the electrode tip (or each of the
+    //links) and see if it's in collision with any of the obstacles around it
+    int nrPoints = linkCollision ? L : L+1;
+    
+    //the points can be checked on different threads; the damage is then
+    //marked in point order, so it is recorded exactly as in the serial loop
+    //(a cell scraped by two points is only counted for the first one)
+    if(pool)
+    {
+        pool->ParallelFor(nrPoints, [this](int j) { FindCollisions(j); });
+        for(int j=0; j<nrPoints; j++)
+            MarkCollisions(j);
+        return;
     }
     
+    for(int j=0; j<nrPoints; j++)
+    {
+        FindCollisions(j);
+        MarkCollisions(j);
+    }
 }
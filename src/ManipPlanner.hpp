@@ -2,6 +2,11 @@
 #define MANIP_PLANNER_HPP_
 
 #include "ManipSimulator.hpp"
+#include "DamageTracker.hpp"
+#include "InsertionTrajectory.hpp"
+#include "StepController.hpp"
+#include "ThreadPool.hpp"
+#include "TickProfiler.hpp"
 #include <math.h>
 #include <iostream>
 
@@ -16,10 +21,61 @@ struct OCTData
     vector<double> angle;    
 };
 
+/**
+ * Tunable constants of the planner (defaults are the hand-tuned values)
+ */
+struct PlannerParameters
+{
+    PlannerParameters(void);
+    
+    //repulsive force constants
+    double alpha, gamma, Q;
+    
+    //attractive force constants
+    double beta;
+    
+    //gain changes when stuck in a local minimum (stage 2): beta is
+    //multiplied by localMinimumBetaFactor and alpha by localMinimumAlphaFactor
+    double localMinimumBetaFactor;
+    double localMinimumAlphaFactor;
+    
+    //OCT Parameters
+    double maxOCTDepth;
+    double angleBandwidth;
+    
+    //take the repulsive field from the anatomy's signed distance field (if it
+    //has one) instead of summing over the sensed obstacles
+    bool useDistanceField;
+    
+    //count damage along the whole length of every link (segment vs. circle)
+    //instead of only at the joints and the tip
+    bool linkCollision;
+    
+    //count damage along the continuous motion of the links since the last
+    //tick (swept collision, see SweptCollision.hpp), so that no wall cell is
+    //skipped however large the steps; implies linkCollision
+    bool sweptCollision;
+    
+    //adaptive stepping: scale the fixed step caps by stepSafety times the
+    //clearance to the sensed walls, between minStepScale (in contact) and
+    //maxStepScale (free space); see StepController.hpp
+    bool adaptiveStep;
+    double stepSafety;
+    double minStepScale;
+    double maxStepScale;
+    
+    //swept stepping: plan every move with the caps scaled by maxStepScale (or
+    //by the adaptive scale, with adaptiveStep) and cut it at stepSafety times
+    //the first contact with a sensed wall along the way (continuous collision
+    //detection, see SweptCollision.hpp), keeping at least minStepScale /
+    //maxStepScale of it
+    bool sweptStep;
+};
+
 class ManipPlanner
 {
 public:
-    ManipPlanner(ManipSimulator * const manipSimulator);
+    ManipPlanner(ManipSimulator * const manipSimulator, const PlannerParameters &params = PlannerParameters());
             
     ~ManipPlanner(void);
 
@@ -48,6 +104,94 @@ public:
  */
     void ConfigurationMove(double &deltaTheta, double &base_deltaX, double &base_deltaY);
     
+    /**
+     * Runs the obstacle loops of ConfigurationMove (OCT scan, collision
+     * checking, repulsive field) on the threads of pool, which is not owned
+     * and must outlive the planner (NULL, the default, runs them serially).
+     * Every partial result is reduced in the serial order, so the moves and
+     * the damage are bit-for-bit the same as without a pool.
+     */
+    void SetThreadPool(ThreadPool *pool);
+    
+    /**
+     * Replays a trajectory planned ahead of time (e.g. by RRTConnectPlanner)
+     * instead of following the potential field: every call to
+     * ConfigurationMove returns the next move of the trajectory (and no move
+     * once it is over). The OCT scan and the collision checker still run, so
+     * the damage is counted as for the field planner. The trajectory is not
+     * copied and must outlive the planner; NULL goes back to the field.
+     */
+    void SetTrajectory(const InsertionTrajectory *trajectory);
+    
+    /**
+     * Returns true once every link has reached its bending limit
+     * (ie: retractionCoeff == -1), at which point the insertion is over.
+     */
+    bool IsFullyInserted(void) const
+    {
+        return retractionCoeff == -1;
+    }
+    
+    int GetStage(void) const
+    {
+        return stage;
+    }
+    
+    int GetTotalCellsDamaged(void) const
+    {
+        return damage.GetNrDamaged();
+    }
+    
+    /**
+     * The scraped wall cells; GetNewlyDamaged() lists the ones scraped
+     * during the last call to ConfigurationMove.
+     */
+    const DamageTracker& GetDamage(void) const
+    {
+        return damage;
+    }
+    
+    /**
+     * Bound on how far any point of the electrode moved with the last move
+     * (see StepReach), for analysis of the step sizes
+     */
+    double GetLastStepSize(void) const
+    {
+        return lastStepSize;
+    }
+    
+    /**
+     * Per-phase latency histograms of the ticks (see TickProfiler.hpp); NULL
+     * unless built with COCHLEAMP_ENABLE_PROFILING
+     */
+    TickProfiler* GetProfiler(void)
+    {
+#ifdef COCHLEAMP_ENABLE_PROFILING
+        return &profiler;
+#else
+        return NULL;
+#endif
+    }
+    
+    /**
+     * Distance from the electrode to the closest sensed wall surface when the
+     * last move was planned (only computed in adaptive stepping mode, HUGE_VAL
+     * otherwise)
+     */
+    double GetLastClearance(void) const
+    {
+        return lastClearance;
+    }
+    
+    /**
+     * Fraction of the planned move at which the electrode would have first
+     * touched a sensed wall (only computed in swept stepping mode; HUGE_VAL
+     * if the move was free)
+     */
+    double GetLastContactTime(void) const
+    {
+        return lastContactTime;
+    }
         
 protected:
     ManipSimulator  *m_manipSimulator;
@@ -61,14 +205,51 @@ protected:
     double GetAngleFromXAxis(const int i);
     void CollisionChecker();    
     
+    //collision checking of joint (or link) j, split between a search that can
+    //run concurrently for all j and the marking of the damage, done in j order
+    void FindCollisions(int j);
+    void MarkCollisions(int j);
+    vector< vector<int> > collisionIds;
+    vector< vector<char> > collisionHits;
+    
     //internal variables for scanning OCT, detecting obstacles, etc
-    OCTData ScanOCT(void);
+    void ScanOCT(OCTData &data);
+    OCTData oct;
     vector<int> sensedPoints;
     vector<bool> sensedObstacles;
     
+    //dense, append-only list of the sensed obstacles (in the order they were
+    //first sensed) with packed copies of their coordinates, so that the
+    //repulsive field only walks what the OCT has actually seen
+    void AddSensedObstacle(int i);
+    vector<int> sensedList;
+    vector<double> sensedX;
+    vector<double> sensedY;
+    vector<double> sensedR;
+    
+    //scratch buffer for the obstacles returned by the simulator's radius queries
+    vector<int> nearbyObstacles;
+    
+    //scratch buffers for the batch closest-point query in ScanOCT
+    vector<double> octClosestX;
+    vector<double> octClosestY;
+    vector<double> octCenterDist;
+    
+    //per-obstacle OCT classification (see ClassifyOCTRange)
+    void ClassifyOCTRange(int begin, int end);
+    static const int OCT_NOT_SEEN = 2;
+    vector<int> octAngle;
+    vector<double> octDepth;
+    Point octTip;
+    double octTipAngle;
+    
+    //intra-tick threading (see SetThreadPool): ranges of PARALLEL_GRAIN
+    //obstacles per task, so small anatomies stay on the calling thread
+    ThreadPool *pool;
+    static const int PARALLEL_GRAIN = 256;
+    
     //cochlear wall "scraping" checker variables
-    vector<bool> scrapedObstacles;
-    int totalCellsDamaged;
+    DamageTracker damage;
     
     //OCT Parameters
     double MAX_OCT_DEPTH;
@@ -76,16 +257,62 @@ protected:
     
     //potential field functions
     Point RepulsiveForceAtPointFromObstacle(Point, int);
+    Point RepulsiveForceAtPointFromClosestPoint(Point p, Point o);
     Point AttractiveForce();
-    double* WSF2CSF(Point force, int j);
-    double* RepulsiveCSFAtLink(int j);
+    void WSF2CSF(Point force, int j, double csf[]);
+    void RepulsiveCSFAtLink(int j, double totalCSF[]);
+    Point RepulsiveForceFromDistanceField(const DistanceField *field, Point p);
+    
+    void BuildJacobian(int j);
+    void BuildJacobians(void);
+    
+    //preallocated workspaces for the force pipeline: the C-space force of a
+    //link (#links + 2 entries) and the Jacobian rows of every link endpoint
+    //(#links x (#links + 2) entries each)
+    void ReserveWorkspace(int L);
+    vector<double> linkCSF;
+    vector<double> jacobianX;
+    vector<double> jacobianY;
+    
+    //C-space forces of every link, one row each, when they are computed concurrently
+    vector<double> linkCSFRows;
     
     //repulsive force constants
     double alpha, gamma, Q;
+    bool useDistanceField;
+    
+    //collision model (see PlannerParameters::linkCollision and sweptCollision)
+    bool linkCollision;
+    bool sweptCollision;
+    ElectrodeConfiguration previousConfiguration;
+    
+    //adaptive stepping (see PlannerParameters::adaptiveStep)
+    double SensedClearance(void);
+    double GetElectrodeLength(void);
+    bool adaptiveStep;
+    double stepSafety, minStepScale, maxStepScale;
+    double lastStepSize, lastClearance;
+    
+    //swept stepping (see PlannerParameters::sweptStep)
+    void ClipMoveAtFirstContact(double &deltaTheta, double &baseDeltaX, double &baseDeltaY);
+    bool sweptStep;
+    SweptCollision sweep;
+    ElectrodeConfiguration sweepFrom, sweepTo;
+    double lastContactTime;
+    
+    //trajectory replay (see SetTrajectory)
+    const InsertionTrajectory *trajectory;
+    int trajectoryTick;
+    
+#ifdef COCHLEAMP_ENABLE_PROFILING
+    TickProfiler profiler;
+#endif
     
     //attractive force constants
     double beta;
     
+    //local minimum escape factors
+    double localMinimumBetaFactor, localMinimumAlphaFactor;
     
     //algorithm stage param
     int stage;
@@ -94,6 +321,8 @@ protected:
     bool displayedMessage;
     
     friend class Graphics;
+    friend class PlannerBenchmark;
+    friend struct SimulationSnapshot;
 };
 
 #endif
@@ -2,20 +2,41 @@
 
 ManipSimulator::ManipSimulator(const char fname[])
 {
-	base_x = -8;
-	base_y = 3.5;
-    m_positions.push_back(base_x);
-    m_positions.push_back(base_y);
-
-    m_circles.push_back(5);
-    m_circles.push_back(0.6);
-    m_circles.push_back(0.2);    
-
+    Init();
     SetupFromFile(fname);
 }
 
+ManipSimulator::ManipSimulator(const Anatomy * const anatomy)
+{
+    Init();
+    m_anatomy      = anatomy;
+    m_ownedAnatomy = NULL;
+}
+
 ManipSimulator::~ManipSimulator(void)
 {
+    if(m_ownedAnatomy)
+	delete m_ownedAnatomy;
+}
+
+void ManipSimulator::Init(void)
+{
+	base_x = -8;
+	base_y = 3.5;
+    m_positions.push_back(base_x);
+    m_positions.push_back(base_y);
+    m_chain.push_back(0);
+    m_chain.push_back(0);
+    m_fkBaseX   = base_x;
+    m_fkBaseY   = base_y;
+    m_dirtyFrom = 0;
+
+    m_goalX      = 5;
+    m_goalY      = 0.6;
+    m_goalRadius = 0.2;
+
+    m_anatomy      = NULL;
+    m_ownedAnatomy = NULL;
 }
 
 bool ManipSimulator::HasRobotReachedGoal(void) const
@@ -33,32 +54,96 @@ void ManipSimulator::AddLink(const double length)
     m_joints.push_back(0);
     m_lengths.push_back(length);
     m_positions.resize(m_positions.size() + 2);	
+    m_chain.resize(m_chain.size() + 2);
+    m_absAngles.push_back(0);
+    MarkJointDirty(m_joints.size() - 1);
+}
+
+void ManipSimulator::SetupLinks(const int nrLinks, const double linkLength)
+{
+    theta_limits.resize(nrLinks);
+    for(int i = 0; i < nrLinks; ++i)
+    {
+        AddLink(linkLength);
+        theta_limits[i] = -(4.0/3*M_PI)/nrLinks + ((nrLinks-i+0.0)/nrLinks*(13))/180*M_PI; //backoff varies from 13 to 0
+    }
+    FK();
+}
+
+void ManipSimulator::ApplyMove(const double dtheta, const double dx, const double dy)
+{
+    base_x += dx;
+    base_y += dy;
+    AddToLinkTheta(dtheta);
+    FK();
 }
 
 void ManipSimulator::AddToLinkTheta(double dtheta)
 {
+	const int n = this->GetNrLinks();
+	if(n > 0)
+		MarkJointDirty(SpreadBend(dtheta, &m_joints[0], &theta_limits[0], n));
+}
+
+int ManipSimulator::SpreadBend(double dtheta, double joints[], const double limits[], const int n)
+{
+	int first = n;
 	dtheta = -dtheta;
 	if(dtheta > 0) {
-		for(int i = this->GetNrLinks()-1; i > -1; i--) {
-			if(m_joints[i] - dtheta < theta_limits[i]) {
-				dtheta -= theta_limits[i]-m_joints[i];
-				m_joints[i] = theta_limits[i];
+		for(int i = n-1; i > -1; i--) {
+			first = i;
+			if(joints[i] - dtheta < limits[i]) {
+				dtheta -= limits[i]-joints[i];
+				joints[i] = limits[i];
 			} else {
-				m_joints[i] -= dtheta;
+				joints[i] -= dtheta;
 				break;
 			}
 		}
 	} else if(dtheta < 0) {
-		for(int i = 0; i < this->GetNrLinks(); i++) {
-			if(m_joints[i] - dtheta > 0) {
-				dtheta -= m_joints[i];
-				m_joints[i] = 0;
+		for(int i = 0; i < n; i++) {
+			if(first == n)
+				first = i;
+			if(joints[i] - dtheta > 0) {
+				dtheta -= joints[i];
+				joints[i] = 0;
 			} else {
-				m_joints[i] -= dtheta;
+				joints[i] -= dtheta;
 				break;
 			}
 		}
 	}
+	return first;
+}
+
+void ManipSimulator::GetConfiguration(ElectrodeConfiguration &config) const
+{
+    config.baseX  = base_x;
+    config.baseY  = base_y;
+    config.joints = m_joints;
+}
+
+void ManipSimulator::SetConfiguration(const ElectrodeConfiguration &config)
+{
+    base_x = config.baseX;
+    base_y = config.baseY;
+    for(int i = 0; i < GetNrLinks(); ++i)
+	if(m_joints[i] != config.joints[i])
+	{
+	    m_joints[i] = config.joints[i];
+	    MarkJointDirty(i);
+	}
+    FK();
+}
+
+void ManipSimulator::GetConfigurationAfterMove(const double dtheta, const double dx, const double dy,
+					       ElectrodeConfiguration &config) const
+{
+    GetConfiguration(config);
+    config.baseX += dx;
+    config.baseY += dy;
+    if(!config.joints.empty())
+	SpreadBend(dtheta, &config.joints[0], &theta_limits[0], config.joints.size());
 }
 
 Point ManipSimulator::ClosestPointOnObstacleAtMaxDist(const int i, const double x, const double y, const double dist)
@@ -103,84 +188,49 @@ Point ManipSimulator::ClosestPointOnObstacle(const int i, const double x, const
     
 }
 
-void MatrixMultMatrix(const double M1[6], const double M2[6], double M[6])
-{
-    double Mresult[6];
-
-    Mresult[0] = M1[0] * M2[0] + M1[1] * M2[3];
-    Mresult[1] = M1[0] * M2[1] + M1[1] * M2[4];
-    Mresult[2] = M1[0] * M2[2] + M1[1] * M2[5] + M1[2];
-
-    Mresult[3] = M1[3] * M2[0] + M1[4] * M2[3];
-    Mresult[4] = M1[3] * M2[1] + M1[4] * M2[4];
-    Mresult[5] = M1[3] * M2[2] + M1[4] * M2[5] + M1[5];
-    
-    M[0] = Mresult[0];
-    M[1] = Mresult[1];
-    M[2] = Mresult[2];
-    M[3] = Mresult[3];
-    M[4] = Mresult[4];
-    M[5] = Mresult[5];
-}
-
 void ManipSimulator::FK(void)
 {
     const int n = GetNrLinks();
     
-    double M[6];
-    double Mall[6];
-    double p[2] = {0, 0};
-    double pnew[2];
-    
-    
-    Mall[0] = Mall[4] = 1;
-    Mall[1] = Mall[2] = Mall[3] = Mall[5] = 0;
-    
-    m_positions[0] = base_x;
-    m_positions[1] = base_y;
-    for(int i = 0; i < n; ++i)
+    //the chain relative to the base only changes from the first joint that
+    //moved since the last call; the links before it keep their transforms
+    const int start = m_dirtyFrom;
+    if(start < n)
     {
-	const double ctheta = cos(GetLinkTheta(i));
-	const double stheta = sin(GetLinkTheta(i));
+	double angle = start > 0 ? m_absAngles[start - 1] : 0;
+	double x     = m_chain[2 * start];
+	double y     = m_chain[2 * start + 1];
 	
-	M[0] = ctheta;  M[1] = -stheta; M[2] = GetLinkLength(i) * ctheta;
-	M[3] = stheta;  M[4] =  ctheta; M[5] = GetLinkLength(i) * stheta;
-
-	MatrixMultMatrix(Mall, M, Mall);
-
-	m_positions[2 * i + 2] = Mall[2] + base_x;
-	m_positions[2 * i + 3] = Mall[5] + base_y;;
+	for(int i = start; i < n; ++i)
+	{
+	    angle += GetLinkTheta(i);
+	    x     += GetLinkLength(i) * cos(angle);
+	    y     += GetLinkLength(i) * sin(angle);
+	    
+	    m_absAngles[i]       = angle;
+	    m_chain[2 * i + 2] = x;
+	    m_chain[2 * i + 3] = y;
+	}
+    }
+    
+    //a base translation is a pure offset of every position, while joint
+    //changes only move the links after the first changed joint
+    const int first = (base_x != m_fkBaseX || base_y != m_fkBaseY) ? 0 : start + 1;
+    for(int i = first; i <= n; ++i)
+    {
+	m_positions[2 * i]     = m_chain[2 * i] + base_x;
+	m_positions[2 * i + 1] = m_chain[2 * i + 1] + base_y;
     }
+    
+    m_fkBaseX   = base_x;
+    m_fkBaseY   = base_y;
+    m_dirtyFrom = n;
 }
 
 
 void ManipSimulator::SetupFromFile(const char fname[])
 {
-	//file with obstacles (x y r)
-	FILE *in = fopen(fname, "r");
-	if(in)
-	{
-		int nrObstacles;
-		double x; double y; double r;
-
-		if(fscanf(in, "%d", &nrObstacles) != 1)
-		{
-			printf("error: expecting number of obstacles\n");
-			fclose(in);
-			return;
-		}
-
-		for(int i=0; i<nrObstacles; i++)
-		{
-			if(fscanf(in, "%lf %lf %lf", &x, &y, &r) != 3)
-			{
-				printf("invalid obstacle definition, expecting x y r\n");
-				fclose(in);
-				return;
-			}
-			m_circles.push_back(x);
-			m_circles.push_back(y);
-			m_circles.push_back(r);
-		}
-	}
+	m_ownedAnatomy = new Anatomy();
+	m_ownedAnatomy->LoadFromFile(fname);
+	m_anatomy = m_ownedAnatomy;
 }
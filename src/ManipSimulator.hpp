@@ -6,6 +6,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <vector>
+#include "Anatomy.hpp"
+#include "SweptCollision.hpp"
 
 struct Point
 {
@@ -19,21 +21,45 @@ class ManipSimulator
 public:    
     ManipSimulator(const char fname[]);
     
+    /**
+     *@brief Simulates the electrode inside an anatomy loaded elsewhere. The anatomy
+     *       is only read, never modified, and must outlive the simulator.
+     */
+    ManipSimulator(const Anatomy * const anatomy);
+    
     ~ManipSimulator(void);
     
     double GetGoalCenterX(void) const
     {
-	return m_circles[0];	
+	return m_goalX;	
     }
 
     double GetGoalCenterY(void) const
     {
-	return m_circles[1];	
+	return m_goalY;	
+    }
+
+    double GetGoalRadius(void) const
+    {
+	return m_goalRadius;
     }
 
     int GetNrObstacles(void) const
     {
-	return m_circles.size() / 3 - 1;
+	return m_anatomy->GetNrObstacles();
+    }
+
+    /**
+     *@brief Obstacles as a structure of arrays (for batch queries)
+     */
+    const ObstacleSet& GetObstacles(void) const
+    {
+	return m_anatomy->GetObstacles();
+    }
+
+    const Anatomy* GetAnatomy(void) const
+    {
+	return m_anatomy;
     }
 
     /**
@@ -47,6 +73,25 @@ public:
      */
     Point ClosestPointOnObstacleAtMaxDist(const int i, const double x, const double y, const double dist);
 
+    /**
+     *@brief Collects (in increasing order) the obstacles whose center is within d of point [x, y].
+     *       Uses the uniform grid built in SetupFromFile, so the cost depends on the
+     *       number of obstacles around [x, y] and not on the total number of obstacles.
+     */
+    void GetObstaclesNear(const double x, const double y, const double d, std::vector<int> &ids) const
+    {
+	m_anatomy->GetGrid().GetObstaclesWithinDist(x, y, d, ids);
+    }
+
+    /**
+     *@brief Largest obstacle radius; add it to a surface distance to get a center distance
+     *       suitable for GetObstaclesNear
+     */
+    double GetMaxObstacleRadius(void) const
+    {
+	return m_anatomy->GetGrid().GetMaxRadius();
+    }
+
     int GetNrLinks(void) const
     {
 	return m_joints.size();
@@ -77,6 +122,15 @@ public:
         return m_joints[i];
     }
 
+    /**
+     *@brief Absolute angle of link i w.r.t. the x-axis, ie, the sum of joint angles 0..i
+     *       (cached by FK, so it is valid for the configuration of the last FK call)
+     */
+    double GetLinkAbsoluteAngle(const int i) const
+    {
+	return m_absAngles[i];
+    }
+
     double GetLinkThetaLimit(const int i) const
     {
         return theta_limits[i];
@@ -93,33 +147,72 @@ public:
 
     bool HasRobotReachedGoal(void) const;
 
+    /**
+     *@brief Adds nrLinks links of the given length and sets up the bending
+     *       limit of each joint (backoff varies from 13 deg at the base to 0 at the tip)
+     */
+    void SetupLinks(const int nrLinks, const double linkLength);
+
+    double GetLinkLength(const int i) const
+    {
+	return m_lengths[i];
+    }
+
+    const std::vector<double>& GetLinkLengths(void) const
+    {
+	return m_lengths;
+    }
+
+    /**
+     *@brief Current base position and joint angles
+     */
+    void GetConfiguration(ElectrodeConfiguration &config) const;
+
+    /**
+     *@brief Puts the electrode in the given configuration (e.g. a recorded one,
+     *       see TrajectoryLog.hpp) and recomputes the link positions
+     */
+    void SetConfiguration(const ElectrodeConfiguration &config);
+
+    /**
+     *@brief Configuration that ApplyMove(dtheta, dx, dy) would lead to (the
+     *       electrode is not moved)
+     */
+    void GetConfigurationAfterMove(const double dtheta, const double dx, const double dy,
+				   ElectrodeConfiguration &config) const;
+
+    /**
+     *@brief Spreads a bend over the joints as ApplyMove does: joints are filled
+     *       up to their limits from the tip (dtheta > 0) or relaxed back to 0
+     *       from the base (dtheta < 0)
+     *
+     *@return first joint changed (n if none)
+     */
+    static int SpreadBend(double dtheta, double joints[], const double limits[], const int n);
+
+    /**
+     *@brief Applies one planner move (as returned by ManipPlanner::ConfigurationMove)
+     *       to the electrode and recomputes the link positions
+     */
+    void ApplyMove(const double dtheta, const double dx, const double dy);
+
 protected:
 
     double GetObstacleCenterX(const int i) const
     {
-	return m_circles[3 * i + 3];
+	return m_anatomy->GetObstacles().GetCenterX(i);
     }
     
     double GetObstacleCenterY(const int i) const
     {
-	return m_circles[3 * i + 4];
+	return m_anatomy->GetObstacles().GetCenterY(i);
     }
     
     double GetObstacleRadius(const int i) const
     {
-	return m_circles[3 * i + 5];
+	return m_anatomy->GetObstacles().GetRadius(i);
     }
 
-    double GetLinkLength(const int i) const
-    {
-	return m_lengths[i];
-    }
-
-    double GetGoalRadius(void) const
-    {
-	return m_circles[2];
-    }
-    
     void FK(void);
 
 
@@ -130,6 +223,16 @@ protected:
     void AddToLinkTheta(const int i, const double dtheta)
     {
 	m_joints[i] += dtheta;
+	MarkJointDirty(i);
+    }
+
+    /**
+     *@brief Records that joint i changed, so the next FK recomputes the chain from i onward
+     */
+    void MarkJointDirty(const int i)
+    {
+	if(i < m_dirtyFrom)
+	    m_dirtyFrom = i;
     }
 
     void AddToLinkTheta(const double dtheta);
@@ -141,10 +244,29 @@ protected:
      */
     void SetupFromFile(const char fname[]);
 
+    /**
+     *@brief Common initialization of the electrode base, goal and FK cache
+     */
+    void Init(void);
+
     std::vector<double> m_joints;
     std::vector<double> m_lengths;
     std::vector<double> m_positions;
-    std::vector<double> m_circles;
+
+    //FK cache: cumulative joint angles, link end positions relative to the base,
+    //the base used by the last FK and the first joint changed since then
+    std::vector<double> m_absAngles;
+    std::vector<double> m_chain;
+    double m_fkBaseX;
+    double m_fkBaseY;
+    int    m_dirtyFrom;
+    //obstacles: either loaded (and owned) by this simulator or shared
+    const Anatomy *m_anatomy;
+    Anatomy       *m_ownedAnatomy;
+
+    double m_goalX;
+    double m_goalY;
+    double m_goalRadius;
 
     std::vector<double> theta_limits;
 
@@ -152,6 +274,7 @@ protected:
     double base_y;
     
     friend class Graphics;
+    friend class PlannerBenchmark;
 };
 
 #endif
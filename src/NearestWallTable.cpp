@@ -0,0 +1,297 @@
+#include "NearestWallTable.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NEAREST_WALL_MKDIR
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+//alignment of the arrays in a cache file
+static const uint64_t FILE_ALIGNMENT = 64;
+
+static uint64_t AlignUp(const uint64_t offset)
+{
+    return (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+}
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static const uint64_t FNV_PRIME        = 1099511628211ull;
+
+static uint64_t HashBytes(uint64_t hash, const void *data, const uint64_t size)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    for(uint64_t i = 0; i < size; ++i)
+    {
+	hash ^= bytes[i];
+	hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+bool HashFileContents(const char fname[], uint64_t &hash)
+{
+    MappedFile file;
+    if(!file.Open(fname))
+	return false;
+
+    hash = HashBytes(FNV_OFFSET_BASIS, file.GetData(), file.GetSize());
+    return true;
+}
+
+const char* GetNearestWallCacheDirectory(void)
+{
+    const char *dir = getenv(NEAREST_WALL_CACHE_ENV);
+    return dir && dir[0] ? dir : NEAREST_WALL_CACHE_DIR;
+}
+
+NearestWallParameters::NearestWallParameters(void)
+{
+    resolution  = 0.02;
+    maxDistance = 2;
+}
+
+NearestWallTable::NearestWallTable(void)
+{
+    m_indices   = NULL;
+    m_distances = NULL;
+    Clear();
+}
+
+NearestWallTable::~NearestWallTable(void)
+{
+}
+
+void NearestWallTable::Clear(void)
+{
+    m_minX = m_minY = 0;
+    m_resolution   = 1;
+    m_maxDistance  = 0;
+    m_halfDiagonal = 0;
+    m_nrCellsX = m_nrCellsY = 0;
+    m_nrObstacles = 0;
+    m_indices   = NULL;
+    m_distances = NULL;
+    std::vector<int32_t>().swap(m_ownedIndices);
+    std::vector<double>().swap(m_ownedDistances);
+    m_mapping.Close();
+}
+
+void NearestWallTable::Build(const ObstacleSet &obstacles, const ObstacleGrid &grid, const NearestWallParameters &params)
+{
+    const int n = obstacles.GetNrObstacles();
+
+    Clear();
+    if(n == 0 || !(params.resolution > 0))
+	return;
+
+    m_nrObstacles  = n;
+    m_resolution   = params.resolution;
+    m_maxDistance  = params.maxDistance;
+    m_halfDiagonal = 0.5 * sqrt(2.0) * m_resolution;
+
+    //outside the bounding box of the walls grown by maxDistance, every wall
+    //is farther than maxDistance, so the table does not need to cover it
+    double minX = obstacles.GetCenterX(0), maxX = minX;
+    double minY = obstacles.GetCenterY(0), maxY = minY;
+    for(int i = 0; i < n; ++i)
+    {
+	minX = std::min(minX, obstacles.GetCenterX(i) - obstacles.GetRadius(i));
+	minY = std::min(minY, obstacles.GetCenterY(i) - obstacles.GetRadius(i));
+	maxX = std::max(maxX, obstacles.GetCenterX(i) + obstacles.GetRadius(i));
+	maxY = std::max(maxY, obstacles.GetCenterY(i) + obstacles.GetRadius(i));
+    }
+    m_minX     = minX - m_maxDistance;
+    m_minY     = minY - m_maxDistance;
+    m_nrCellsX = 1 + (int) ((maxX + m_maxDistance - m_minX) / m_resolution);
+    m_nrCellsY = 1 + (int) ((maxY + m_maxDistance - m_minY) / m_resolution);
+
+    m_ownedIndices.resize((size_t) m_nrCellsX * m_nrCellsY);
+    m_ownedDistances.resize((size_t) m_nrCellsX * m_nrCellsY);
+
+    //only obstacles whose surface is within maxDistance of a cell center matter
+    const double     reach = m_maxDistance + grid.GetMaxRadius();
+    std::vector<int> ids;
+
+    for(int iy = 0; iy < m_nrCellsY; ++iy)
+	for(int ix = 0; ix < m_nrCellsX; ++ix)
+	{
+	    const double x       = m_minX + (ix + 0.5) * m_resolution;
+	    const double y       = m_minY + (iy + 0.5) * m_resolution;
+	    double       d       = m_maxDistance;
+	    int          nearest = -1;
+
+	    grid.GetObstaclesWithinDist(x, y, reach, ids);
+	    for(int k = 0; k < (int) ids.size(); ++k)
+	    {
+		const int    i  = ids[k];
+		const double dx = obstacles.GetCenterX(i) - x;
+		const double dy = obstacles.GetCenterY(i) - y;
+		const double di = sqrt(dx * dx + dy * dy) - obstacles.GetRadius(i);
+		if(di < d)
+		{
+		    d       = di;
+		    nearest = i;
+		}
+	    }
+	    m_ownedIndices[(size_t) iy * m_nrCellsX + ix]   = nearest;
+	    m_ownedDistances[(size_t) iy * m_nrCellsX + ix] = d;
+	}
+
+    m_indices   = &m_ownedIndices[0];
+    m_distances = &m_ownedDistances[0];
+}
+
+static bool WriteAt(FILE *out, const uint64_t offset, const void *data, const uint64_t size)
+{
+    //zero padding up to the aligned offset
+    static const char zeros[FILE_ALIGNMENT] = {0};
+    const long        pos = ftell(out);
+
+    if(pos < 0 || (uint64_t) pos > offset ||
+       fwrite(zeros, 1, offset - pos, out) != offset - pos)
+	return false;
+    return size == 0 || fwrite(data, 1, size, out) == size;
+}
+
+bool NearestWallTable::Save(const char fname[], const uint64_t contentHash) const
+{
+    if(IsEmpty())
+	return false;
+
+    const uint64_t nrCells = (uint64_t) m_nrCellsX * m_nrCellsY;
+
+    NearestWallFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NEAREST_WALL_FILE_MAGIC, sizeof(header.magic));
+    header.version         = NEAREST_WALL_FILE_VERSION;
+    header.byteOrder       = OBSTACLE_FILE_BYTEORDER;
+    header.contentHash     = contentHash;
+    header.nrObstacles     = m_nrObstacles;
+    header.resolution      = m_resolution;
+    header.maxDistance     = m_maxDistance;
+    header.minX            = m_minX;
+    header.minY            = m_minY;
+    header.nrCellsX        = m_nrCellsX;
+    header.nrCellsY        = m_nrCellsY;
+    header.indicesOffset   = AlignUp(sizeof(header));
+    header.distancesOffset = AlignUp(header.indicesOffset + nrCells * sizeof(int32_t));
+    header.fileSize        = header.distancesOffset + nrCells * sizeof(double);
+
+    FILE *out = fopen(fname, "wb");
+    if(out == NULL)
+	return false;
+
+    bool ok =
+	WriteAt(out, 0, &header, sizeof(header)) &&
+	WriteAt(out, header.indicesOffset, m_indices, nrCells * sizeof(int32_t)) &&
+	WriteAt(out, header.distancesOffset, m_distances, nrCells * sizeof(double));
+    if(fclose(out) != 0)
+	ok = false;
+
+    return ok;
+}
+
+bool NearestWallTable::Load(const char fname[], const uint64_t contentHash, const int nrObstacles)
+{
+    Clear();
+
+    if(!m_mapping.Open(fname) || m_mapping.GetSize() < sizeof(NearestWallFileHeader))
+    {
+	m_mapping.Close();
+	return false;
+    }
+
+    const NearestWallFileHeader &header = *(const NearestWallFileHeader *) m_mapping.GetData();
+    const uint64_t nrCells = (uint64_t) (header.nrCellsX > 0 ? header.nrCellsX : 0) * (header.nrCellsY > 0 ? header.nrCellsY : 0);
+
+    bool ok =
+	memcmp(header.magic, NEAREST_WALL_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+	header.version == NEAREST_WALL_FILE_VERSION &&
+	header.byteOrder == OBSTACLE_FILE_BYTEORDER &&
+	header.fileSize == m_mapping.GetSize() &&
+	header.contentHash == contentHash &&
+	header.nrObstacles == (uint64_t) nrObstacles &&
+	header.resolution > 0 && nrCells > 0 && nrCells < (1ull << 31) &&
+	header.indicesOffset % FILE_ALIGNMENT == 0 && header.distancesOffset % FILE_ALIGNMENT == 0 &&
+	header.indicesOffset >= sizeof(header) && header.distancesOffset >= sizeof(header) &&
+	header.indicesOffset <= header.fileSize && nrCells * sizeof(int32_t) <= header.fileSize - header.indicesOffset &&
+	header.distancesOffset <= header.fileSize && nrCells * sizeof(double) <= header.fileSize - header.distancesOffset;
+
+    //lookups hand the indices to the obstacle arrays, so check every one of them
+    const int32_t *indices = ok ? (const int32_t *) (m_mapping.GetData() + header.indicesOffset) : NULL;
+    for(uint64_t c = 0; ok && c < nrCells; ++c)
+	ok = indices[c] >= -1 && indices[c] < nrObstacles;
+
+    if(!ok)
+    {
+	Clear();
+	return false;
+    }
+
+    m_minX         = header.minX;
+    m_minY         = header.minY;
+    m_resolution   = header.resolution;
+    m_maxDistance  = header.maxDistance;
+    m_halfDiagonal = 0.5 * sqrt(2.0) * m_resolution;
+    m_nrCellsX     = header.nrCellsX;
+    m_nrCellsY     = header.nrCellsY;
+    m_nrObstacles  = nrObstacles;
+    m_indices      = indices;
+    m_distances    = (const double *) (m_mapping.GetData() + header.distancesOffset);
+
+    return true;
+}
+
+bool NearestWallTable::LoadOrBuild(const char obstacleFname[], const ObstacleSet &obstacles, const ObstacleGrid &grid,
+				   const NearestWallParameters &params)
+{
+    uint64_t hash;
+    if(!HashFileContents(obstacleFname, hash))
+    {
+	Build(obstacles, grid, params);
+	return !IsEmpty();
+    }
+
+    //a table depends on the obstacles and on its own parameters
+    hash = HashBytes(hash, &params.resolution, sizeof(params.resolution));
+    hash = HashBytes(hash, &params.maxDistance, sizeof(params.maxDistance));
+
+    const char *dir = GetNearestWallCacheDirectory();
+    char        name[32];
+    sprintf(name, "/%016llx.nwt", (unsigned long long) hash);
+    const std::string fname = std::string(dir) + name;
+
+    if(Load(fname.c_str(), hash, obstacles.GetNrObstacles()))
+	return true;
+
+    Build(obstacles, grid, params);
+    if(IsEmpty())
+	return false;
+
+#ifdef NEAREST_WALL_MKDIR
+    mkdir(dir, 0755);
+
+    //several processes may build the same table at once: write a private
+    //file and rename it into place, so readers never see a partial table
+    char suffix[32];
+    sprintf(suffix, ".%ld.tmp", (long) getpid());
+    const std::string tmpName = fname + suffix;
+#else
+    const std::string tmpName = fname + ".tmp";
+#endif
+
+    if(!Save(tmpName.c_str(), hash) || rename(tmpName.c_str(), fname.c_str()) != 0)
+    {
+	remove(tmpName.c_str());
+	printf("warning: cannot write nearest-wall cache %s\n", fname.c_str());
+    }
+
+    return true;
+}
@@ -0,0 +1,194 @@
+/**
+ *@file NearestWallTable.hpp
+ *@brief Rasterized nearest-wall lookup: for every cell of a regular grid over the
+ *       workspace, the index of the closest obstacle and the distance to its surface
+ *       from the cell center. Tables are cached on disk, keyed by a hash of the
+ *       obstacle file contents and of the table parameters, and memory-mapped back in,
+ *       so a known anatomy costs a file map instead of a rebuild.
+ *
+ * Cache file layout (native byte order, checked through a byte-order marker):
+ *   NearestWallFileHeader
+ *   indices[nrCellsX * nrCellsY]     int32, -1 if no wall within maxDistance, 64-byte aligned
+ *   distances[nrCellsX * nrCellsY]   doubles, clamped to maxDistance, 64-byte aligned
+ */
+
+#ifndef NEAREST_WALL_TABLE_HPP_
+#define NEAREST_WALL_TABLE_HPP_
+
+#include "ObstacleFile.hpp"
+#include "ObstacleGrid.hpp"
+#include "ObstacleSet.hpp"
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#define NEAREST_WALL_FILE_MAGIC   "CMPNWLT"
+#define NEAREST_WALL_FILE_VERSION 1
+
+//environment variable naming the cache directory; defaults to NEAREST_WALL_CACHE_DIR
+#define NEAREST_WALL_CACHE_ENV    "COCHLEAMP_CACHE_DIR"
+#define NEAREST_WALL_CACHE_DIR    ".cochleamp_cache"
+
+struct NearestWallParameters
+{
+    NearestWallParameters(void);
+
+    //size of the table cells
+    double resolution;
+
+    //walls farther than maxDistance from a cell center are not recorded
+    double maxDistance;
+};
+
+struct NearestWallFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+
+    //hash of the obstacle file contents and of the parameters below
+    uint64_t contentHash;
+    uint64_t nrObstacles;
+
+    double   resolution;
+    double   maxDistance;
+    double   minX;
+    double   minY;
+    int32_t  nrCellsX;
+    int32_t  nrCellsY;
+
+    uint64_t indicesOffset;
+    uint64_t distancesOffset;
+};
+
+class NearestWallTable
+{
+public:
+    NearestWallTable(void);
+
+    ~NearestWallTable(void);
+
+    /**
+     *@brief Computes the table in memory from the obstacles (found through the grid)
+     */
+    void Build(const ObstacleSet &obstacles, const ObstacleGrid &grid, const NearestWallParameters &params);
+
+    /**
+     *@brief Writes the table as a cache file tagged with contentHash
+     */
+    bool Save(const char fname[], const uint64_t contentHash) const;
+
+    /**
+     *@brief Maps a cache file and uses its arrays without copying
+     *
+     *@return false (and leaves the table empty) unless the file is a valid table
+     *        for contentHash over nrObstacles obstacles
+     */
+    bool Load(const char fname[], const uint64_t contentHash, const int nrObstacles);
+
+    /**
+     *@brief Loads the table for obstacle file obstacleFname from the cache directory
+     *       (see GetNearestWallCacheDirectory), or builds it and stores it there
+     *
+     *@param obstacles, grid the obstacles read from obstacleFname
+     *@return false if the table could not be loaded or built (it is then empty);
+     *        failing to write the cache only prints a warning
+     */
+    bool LoadOrBuild(const char obstacleFname[], const ObstacleSet &obstacles, const ObstacleGrid &grid,
+		     const NearestWallParameters &params);
+
+    void Clear(void);
+
+    bool IsEmpty(void) const
+    {
+	return m_indices == NULL;
+    }
+
+    /**
+     *@brief O(1) lookup of the wall closest to the center of the cell containing [x, y]
+     *
+     *@param dist set to the distance from the cell center to that wall's surface
+     *       (maxDistance if there is none within maxDistance)
+     *@return index of the obstacle, or -1 if none is within maxDistance
+     */
+    int GetNearest(const double x, const double y, double &dist) const
+    {
+	const int c = GetCell(x, y);
+	if(c < 0)
+	{
+	    dist = m_maxDistance;
+	    return -1;
+	}
+	dist = m_distances[c];
+	return m_indices[c];
+    }
+
+    /**
+     *@brief O(1) lower bound on the distance from [x, y] to the surface of any wall
+     *       (the cell center distance minus half the cell diagonal)
+     */
+    double GetDistanceLowerBound(const double x, const double y) const
+    {
+	const int c = GetCell(x, y);
+	return (c < 0 ? m_maxDistance : m_distances[c]) - m_halfDiagonal;
+    }
+
+    double GetResolution(void) const
+    {
+	return m_resolution;
+    }
+
+    double GetMaxDistance(void) const
+    {
+	return m_maxDistance;
+    }
+
+protected:
+    //cell containing [x, y], or -1 outside the table (where every wall is
+    //farther than maxDistance)
+    int GetCell(const double x, const double y) const
+    {
+	const double u = (x - m_minX) / m_resolution;
+	const double v = (y - m_minY) / m_resolution;
+	if(!(u >= 0 && v >= 0 && u < m_nrCellsX && v < m_nrCellsY))
+	    return -1;
+	return (int) v * m_nrCellsX + (int) u;
+    }
+
+    double m_minX;
+    double m_minY;
+    double m_resolution;
+    double m_maxDistance;
+    double m_halfDiagonal;
+    int    m_nrCellsX;
+    int    m_nrCellsY;
+    int    m_nrObstacles;
+
+    //point either into m_mapping or into the owned vectors
+    const int32_t *m_indices;
+    const double  *m_distances;
+
+    std::vector<int32_t> m_ownedIndices;
+    std::vector<double>  m_ownedDistances;
+    MappedFile           m_mapping;
+
+private:
+    NearestWallTable(const NearestWallTable &);
+    NearestWallTable& operator=(const NearestWallTable &);
+};
+
+/**
+ *@brief 64-bit FNV-1a hash of the contents of a file
+ *
+ *@return false if the file cannot be read
+ */
+bool HashFileContents(const char fname[], uint64_t &hash);
+
+/**
+ *@brief Directory holding the cached tables: $COCHLEAMP_CACHE_DIR if set,
+ *       otherwise .cochleamp_cache in the working directory
+ */
+const char* GetNearestWallCacheDirectory(void);
+
+#endif
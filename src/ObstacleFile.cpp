@@ -0,0 +1,276 @@
+#include "ObstacleFile.hpp"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define OBSTACLE_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//alignment of every array in the file (mappings are page aligned)
+static const uint64_t FILE_ALIGNMENT = 64;
+
+static uint64_t AlignUp(const uint64_t offset)
+{
+    return (offset + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+}
+
+MappedFile::MappedFile(void)
+{
+    m_data   = NULL;
+    m_size   = 0;
+    m_mapped = false;
+}
+
+MappedFile::~MappedFile(void)
+{
+    Close();
+}
+
+bool MappedFile::Open(const char fname[])
+{
+    Close();
+    
+#ifdef OBSTACLE_FILE_MMAP
+    const int fd = open(fname, O_RDONLY);
+    if(fd < 0)
+	return false;
+    
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+	close(fd);
+	return false;
+    }
+    
+    //private mapping: pages are shared with the page cache (and with other
+    //processes mapping the same file) until someone writes to them
+    void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+	return false;
+    
+    m_data   = (char *) data;
+    m_size   = st.st_size;
+    m_mapped = true;
+    return true;
+#else
+    FILE *in = fopen(fname, "rb");
+    if(in == NULL)
+	return false;
+    
+    fseek(in, 0, SEEK_END);
+    const long size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    
+    //operator new gives enough alignment for the header; the arrays in the
+    //file are aligned relative to its start
+    double *data = size > 0 ? new double[(size + sizeof(double) - 1) / sizeof(double)] : NULL;
+    if(data == NULL || fread(data, 1, size, in) != (size_t) size)
+    {
+	delete[] data;
+	fclose(in);
+	return false;
+    }
+    fclose(in);
+    
+    m_data   = (char *) data;
+    m_size   = size;
+    m_mapped = false;
+    return true;
+#endif
+}
+
+void MappedFile::Close(void)
+{
+    if(m_data == NULL)
+	return;
+    
+#ifdef OBSTACLE_FILE_MMAP
+    if(m_mapped)
+	munmap(m_data, m_size);
+    else
+#endif
+	delete[] (double *) m_data;
+    
+    m_data = NULL;
+    m_size = 0;
+}
+
+bool IsBinaryObstacleFile(const char fname[])
+{
+    char  magic[8];
+    FILE *in = fopen(fname, "rb");
+    if(in == NULL)
+	return false;
+    
+    const bool ok = fread(magic, 1, sizeof(magic), in) == sizeof(magic) &&
+	memcmp(magic, OBSTACLE_FILE_MAGIC, sizeof(magic)) == 0;
+    fclose(in);
+    
+    return ok;
+}
+
+static bool WriteAt(FILE *out, const uint64_t offset, const void *data, const uint64_t size)
+{
+    //zero padding up to the aligned offset
+    static const char zeros[FILE_ALIGNMENT] = {0};
+    const long        pos = ftell(out);
+    
+    if(pos < 0 || (uint64_t) pos > offset ||
+       fwrite(zeros, 1, offset - pos, out) != offset - pos)
+	return false;
+    return size == 0 || fwrite(data, 1, size, out) == size;
+}
+
+bool WriteBinaryObstacleFile(const char fname[], const ObstacleSet &obstacles, const ObstacleGrid *grid)
+{
+    const uint64_t n = obstacles.GetNrObstacles();
+    
+    ObstacleFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OBSTACLE_FILE_MAGIC, sizeof(header.magic));
+    header.version     = OBSTACLE_FILE_VERSION;
+    header.byteOrder   = OBSTACLE_FILE_BYTEORDER;
+    header.nrObstacles = n;
+    header.xOffset     = AlignUp(sizeof(header));
+    header.yOffset     = AlignUp(header.xOffset + n * sizeof(double));
+    header.rOffset     = AlignUp(header.yOffset + n * sizeof(double));
+    header.fileSize    = header.rOffset + n * sizeof(double);
+    
+    uint64_t nrCellStarts = 0;
+    if(grid && n > 0)
+    {
+	const ObstacleGrid::Layout layout = grid->GetLayout();
+	nrCellStarts = (uint64_t) layout.nrCellsX * layout.nrCellsY + 1;
+	
+	header.gridMinX        = layout.minX;
+	header.gridMinY        = layout.minY;
+	header.gridCellSize    = layout.cellSize;
+	header.gridMaxRadius   = layout.maxRadius;
+	header.gridNrCellsX    = layout.nrCellsX;
+	header.gridNrCellsY    = layout.nrCellsY;
+	header.cellStartOffset = AlignUp(header.fileSize);
+	header.cellIdsOffset   = AlignUp(header.cellStartOffset + nrCellStarts * sizeof(int32_t));
+	header.fileSize        = header.cellIdsOffset + n * sizeof(int32_t);
+    }
+    
+    FILE *out = fopen(fname, "wb");
+    if(out == NULL)
+    {
+	printf("error: cannot write %s\n", fname);
+	return false;
+    }
+    
+    bool ok = 
+	WriteAt(out, 0, &header, sizeof(header)) &&
+	WriteAt(out, header.xOffset, obstacles.GetCentersX(), n * sizeof(double)) &&
+	WriteAt(out, header.yOffset, obstacles.GetCentersY(), n * sizeof(double)) &&
+	WriteAt(out, header.rOffset, obstacles.GetRadii(), n * sizeof(double));
+    if(ok && nrCellStarts > 0)
+	ok = 
+	    WriteAt(out, header.cellStartOffset, grid->GetCellStarts(), nrCellStarts * sizeof(int32_t)) &&
+	    WriteAt(out, header.cellIdsOffset, grid->GetCellIds(), n * sizeof(int32_t));
+    
+    if(fclose(out) != 0)
+	ok = false;
+    if(!ok)
+	printf("error: failed writing %s\n", fname);
+    
+    return ok;
+}
+
+//true if the array [offset, offset + size) is aligned and inside the file
+static bool IsValidArray(const ObstacleFileHeader &header, const uint64_t offset, const uint64_t size)
+{
+    return offset >= sizeof(header) && offset % FILE_ALIGNMENT == 0 &&
+	offset <= header.fileSize && size <= header.fileSize - offset;
+}
+
+//queries index obstacles through the grid, so a corrupt grid must not be used;
+//this is a linear scan over ints, still far cheaper than parsing a text file
+static bool IsValidGrid(const int32_t cellStart[], const uint64_t nrCellStarts, const int32_t cellIds[], const uint64_t n)
+{
+    if(cellStart[0] != 0 || cellStart[nrCellStarts - 1] != (int32_t) n)
+	return false;
+    for(uint64_t c = 0; c + 1 < nrCellStarts; ++c)
+	if(cellStart[c] > cellStart[c + 1])
+	    return false;
+    for(uint64_t i = 0; i < n; ++i)
+	if(cellIds[i] < 0 || cellIds[i] >= (int32_t) n)
+	    return false;
+    return true;
+}
+
+bool ViewBinaryObstacleFile(const MappedFile &file, ObstacleSet &obstacles, ObstacleGrid &grid, bool &hasGrid)
+{
+    hasGrid = false;
+    
+    if(file.GetSize() < sizeof(ObstacleFileHeader))
+    {
+	printf("error: obstacle file too short\n");
+	return false;
+    }
+    
+    const ObstacleFileHeader &header = *(const ObstacleFileHeader *) file.GetData();
+    const uint64_t            n      = header.nrObstacles;
+    
+    if(memcmp(header.magic, OBSTACLE_FILE_MAGIC, sizeof(header.magic)) != 0)
+    {
+	printf("error: not a binary obstacle file\n");
+	return false;
+    }
+    if(header.byteOrder != OBSTACLE_FILE_BYTEORDER)
+    {
+	printf("error: obstacle file was written on a machine with a different byte order\n");
+	return false;
+    }
+    if(header.version != OBSTACLE_FILE_VERSION)
+    {
+	printf("error: unsupported obstacle file version %u\n", header.version);
+	return false;
+    }
+    if(header.fileSize != file.GetSize() || n > 0x7fffffff ||
+       !IsValidArray(header, header.xOffset, n * sizeof(double)) ||
+       !IsValidArray(header, header.yOffset, n * sizeof(double)) ||
+       !IsValidArray(header, header.rOffset, n * sizeof(double)))
+    {
+	printf("error: corrupt or truncated obstacle file\n");
+	return false;
+    }
+    
+    char *data = file.GetData();
+    obstacles.SetView((double *) (data + header.xOffset), (double *) (data + header.yOffset),
+		      (double *) (data + header.rOffset), (int) n);
+    
+    if(header.cellStartOffset != 0 && n > 0)
+    {
+	const uint64_t nrCellStarts = (uint64_t) header.gridNrCellsX * header.gridNrCellsY + 1;
+	const int32_t *cellStart    = (const int32_t *) (data + header.cellStartOffset);
+	
+	if(header.gridNrCellsX <= 0 || header.gridNrCellsY <= 0 || !(header.gridCellSize > 0) ||
+	   !IsValidArray(header, header.cellStartOffset, nrCellStarts * sizeof(int32_t)) ||
+	   !IsValidArray(header, header.cellIdsOffset, n * sizeof(int32_t)) ||
+	   !IsValidGrid(cellStart, nrCellStarts, (const int32_t *) (data + header.cellIdsOffset), n))
+	{
+	    printf("warning: ignoring corrupt grid in obstacle file\n");
+	    return true;
+	}
+	
+	ObstacleGrid::Layout layout;
+	layout.minX      = header.gridMinX;
+	layout.minY      = header.gridMinY;
+	layout.cellSize  = header.gridCellSize;
+	layout.maxRadius = header.gridMaxRadius;
+	layout.nrCellsX  = header.gridNrCellsX;
+	layout.nrCellsY  = header.gridNrCellsY;
+	grid.SetView(obstacles, layout, cellStart, (const int32_t *) (data + header.cellIdsOffset));
+	hasGrid = true;
+    }
+    
+    return true;
+}
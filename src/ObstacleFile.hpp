@@ -0,0 +1,102 @@
+/**
+ *@file ObstacleFile.hpp
+ *@brief Versioned binary obstacle files that can be memory-mapped and used
+ *       without parsing or copying
+ *
+ * Layout (native byte order, checked through a byte-order marker):
+ *   ObstacleFileHeader
+ *   x[n], y[n], r[n]                     doubles, each array 64-byte aligned
+ *   cellStart[nrCellsX * nrCellsY + 1]   ints, optional precomputed grid
+ *   cellIds[n]                           ints, optional precomputed grid
+ */
+
+#ifndef OBSTACLE_FILE_HPP_
+#define OBSTACLE_FILE_HPP_
+
+#include "ObstacleGrid.hpp"
+#include "ObstacleSet.hpp"
+#include <stdint.h>
+
+#define OBSTACLE_FILE_MAGIC     "CMPOBST"
+#define OBSTACLE_FILE_VERSION   1
+#define OBSTACLE_FILE_BYTEORDER 0x01020304u
+
+struct ObstacleFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t nrObstacles;
+    
+    //byte offsets of the obstacle arrays
+    uint64_t xOffset;
+    uint64_t yOffset;
+    uint64_t rOffset;
+    
+    //precomputed grid; offsets are 0 if the file has no grid
+    uint64_t cellStartOffset;
+    uint64_t cellIdsOffset;
+    double   gridMinX;
+    double   gridMinY;
+    double   gridCellSize;
+    double   gridMaxRadius;
+    int32_t  gridNrCellsX;
+    int32_t  gridNrCellsY;
+};
+
+/**
+ * Read-only (copy-on-write) mapping of a whole file. Where mmap is not
+ * available the file is read into memory instead.
+ */
+class MappedFile
+{
+public:
+    MappedFile(void);
+    
+    ~MappedFile(void);
+
+    bool Open(const char fname[]);
+
+    void Close(void);
+
+    char* GetData(void) const
+    {
+	return m_data;
+    }
+
+    uint64_t GetSize(void) const
+    {
+	return m_size;
+    }
+
+protected:
+    char     *m_data;
+    uint64_t  m_size;
+    bool      m_mapped;
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile& operator=(const MappedFile &);
+};
+
+/**
+ *@brief True if the file starts with the binary obstacle file magic
+ */
+bool IsBinaryObstacleFile(const char fname[]);
+
+/**
+ *@brief Writes obstacles (and, if grid != NULL, the grid built over them) to a binary file
+ */
+bool WriteBinaryObstacleFile(const char fname[], const ObstacleSet &obstacles, const ObstacleGrid *grid);
+
+/**
+ *@brief Validates a mapped binary obstacle file and points obstacles (and grid, if the file
+ *       has one) at its arrays, without copying
+ *
+ *@return false if the file is not a valid obstacle file; hasGrid tells whether
+ *        the grid was set up from the file
+ */
+bool ViewBinaryObstacleFile(const MappedFile &file, ObstacleSet &obstacles, ObstacleGrid &grid, bool &hasGrid);
+
+#endif
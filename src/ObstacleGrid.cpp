@@ -0,0 +1,197 @@
+#include "ObstacleGrid.hpp"
+#include <algorithm>
+#include <cmath>
+
+ObstacleGrid::ObstacleGrid(void)
+{
+    m_minX = m_minY = 0;
+    m_cellSize  = 1;
+    m_maxRadius = 0;
+    m_nrCellsX  = m_nrCellsY = 0;
+    m_x = m_y   = NULL;
+    m_cellStart = m_cellIds = NULL;
+}
+
+ObstacleGrid::~ObstacleGrid(void)
+{
+}
+
+void ObstacleGrid::Build(const ObstacleSet &obstacles, const double cellSize)
+{
+    const int n = obstacles.GetNrObstacles();
+    
+    m_x = obstacles.GetCentersX();
+    m_y = obstacles.GetCentersY();
+    m_ownedCellStart.clear();
+    m_ownedCellIds.clear();
+    m_cellStart = m_cellIds = NULL;
+    m_maxRadius = 0;
+    m_nrCellsX = m_nrCellsY = 0;
+    
+    if(n <= 0)
+	return;
+    
+    double maxX, maxY;
+    m_minX = maxX = obstacles.GetCenterX(0);
+    m_minY = maxY = obstacles.GetCenterY(0);
+    for(int i = 0; i < n; ++i)
+    {
+	m_minX = std::min(m_minX, m_x[i]);
+	m_minY = std::min(m_minY, m_y[i]);
+	maxX   = std::max(maxX, m_x[i]);
+	maxY   = std::max(maxY, m_y[i]);
+	m_maxRadius = std::max(m_maxRadius, obstacles.GetRadius(i));
+    }
+    
+    //pick the cell size so that, on average, a cell holds a few obstacles,
+    //but never make cells smaller than an obstacle
+    m_cellSize = cellSize;
+    if(m_cellSize <= 0)
+    {
+	const double area = std::max(maxX - m_minX, 1e-9) * std::max(maxY - m_minY, 1e-9);
+	m_cellSize = std::max(2 * sqrt(area / n), 2 * m_maxRadius);
+    }
+    if(m_cellSize <= 0)
+	m_cellSize = 1;
+    
+    //keep the grid size reasonable for degenerate inputs
+    const int maxCellsPerAxis = 4096;
+    m_cellSize = std::max(m_cellSize, std::max(maxX - m_minX, maxY - m_minY) / (maxCellsPerAxis - 1));
+    
+    m_nrCellsX = 1 + (int) ((maxX - m_minX) / m_cellSize);
+    m_nrCellsY = 1 + (int) ((maxY - m_minY) / m_cellSize);
+    
+    //counting sort of the obstacles by cell (obstacles keep increasing order inside a cell)
+    std::vector<int> cells(n);
+    std::vector<int> &start = m_ownedCellStart;
+    start.assign(m_nrCellsX * m_nrCellsY + 1, 0);
+    for(int i = 0; i < n; ++i)
+    {
+	cells[i] = GetCellY(m_y[i]) * m_nrCellsX + GetCellX(m_x[i]);
+	start[cells[i] + 1]++;
+    }
+    for(int c = 0; c < m_nrCellsX * m_nrCellsY; ++c)
+	start[c + 1] += start[c];
+    
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    m_ownedCellIds.resize(n);
+    for(int i = 0; i < n; ++i)
+	m_ownedCellIds[fill[cells[i]]++] = i;
+    
+    m_cellStart = &m_ownedCellStart[0];
+    m_cellIds   = &m_ownedCellIds[0];
+}
+
+ObstacleGrid::Layout ObstacleGrid::GetLayout(void) const
+{
+    Layout layout;
+    layout.minX      = m_minX;
+    layout.minY      = m_minY;
+    layout.cellSize  = m_cellSize;
+    layout.maxRadius = m_maxRadius;
+    layout.nrCellsX  = m_nrCellsX;
+    layout.nrCellsY  = m_nrCellsY;
+    return layout;
+}
+
+void ObstacleGrid::SetView(const ObstacleSet &obstacles, const Layout &layout, const int cellStart[], const int cellIds[])
+{
+    m_ownedCellStart.clear();
+    m_ownedCellIds.clear();
+    
+    m_x         = obstacles.GetCentersX();
+    m_y         = obstacles.GetCentersY();
+    m_minX      = layout.minX;
+    m_minY      = layout.minY;
+    m_cellSize  = layout.cellSize;
+    m_maxRadius = layout.maxRadius;
+    m_nrCellsX  = layout.nrCellsX;
+    m_nrCellsY  = layout.nrCellsY;
+    m_cellStart = cellStart;
+    m_cellIds   = cellIds;
+}
+
+int ObstacleGrid::GetCellX(const double x) const
+{
+    const int c = (int) floor((x - m_minX) / m_cellSize);
+    return c < 0 ? 0 : (c >= m_nrCellsX ? m_nrCellsX - 1 : c);
+}
+
+int ObstacleGrid::GetCellY(const double y) const
+{
+    const int c = (int) floor((y - m_minY) / m_cellSize);
+    return c < 0 ? 0 : (c >= m_nrCellsY ? m_nrCellsY - 1 : c);
+}
+
+void ObstacleGrid::GetObstaclesWithinDist(const double x, const double y, const double d, std::vector<int> &ids) const
+{
+    ids.clear();
+    if(m_nrCellsX == 0 || d < 0)
+	return;
+    
+    //query box is entirely outside of the grid
+    if(x + d < m_minX || y + d < m_minY ||
+       x - d > m_minX + m_nrCellsX * m_cellSize || y - d > m_minY + m_nrCellsY * m_cellSize)
+	return;
+    
+    const int    x0 = GetCellX(x - d);
+    const int    x1 = GetCellX(x + d);
+    const int    y0 = GetCellY(y - d);
+    const int    y1 = GetCellY(y + d);
+    //slightly conservative so that callers applying their own exact distance
+    //test never miss an obstacle on the boundary because of rounding
+    const double dd = d * d * (1 + 1e-9);
+    
+    for(int cy = y0; cy <= y1; ++cy)
+	for(int cx = x0; cx <= x1; ++cx)
+	{
+	    const int c = cy * m_nrCellsX + cx;
+	    for(int k = m_cellStart[c]; k < m_cellStart[c + 1]; ++k)
+	    {
+		const int    i  = m_cellIds[k];
+		const double dx = m_x[i] - x;
+		const double dy = m_y[i] - y;
+		if(dx * dx + dy * dy <= dd)
+		    ids.push_back(i);
+	    }
+	}
+    
+    //callers accumulate over the obstacles, so keep the same order as a full scan
+    std::sort(ids.begin(), ids.end());
+}
+
+void ObstacleGrid::GetObstaclesNearSegment(const double ax, const double ay, const double bx, const double by,
+					   const double d, std::vector<int> &ids) const
+{
+    ids.clear();
+    if(m_nrCellsX == 0 || d < 0)
+	return;
+    
+    const double minX = std::min(ax, bx) - d;
+    const double minY = std::min(ay, by) - d;
+    const double maxX = std::max(ax, bx) + d;
+    const double maxY = std::max(ay, by) + d;
+    if(maxX < m_minX || maxY < m_minY ||
+       minX > m_minX + m_nrCellsX * m_cellSize || minY > m_minY + m_nrCellsY * m_cellSize)
+	return;
+    
+    const int    x0 = GetCellX(minX);
+    const int    x1 = GetCellX(maxX);
+    const int    y0 = GetCellY(minY);
+    const int    y1 = GetCellY(maxY);
+    const double dd = d * d * (1 + 1e-9);
+    
+    for(int cy = y0; cy <= y1; ++cy)
+	for(int cx = x0; cx <= x1; ++cx)
+	{
+	    const int c = cy * m_nrCellsX + cx;
+	    for(int k = m_cellStart[c]; k < m_cellStart[c + 1]; ++k)
+	    {
+		const int i = m_cellIds[k];
+		if(SquaredDistanceToSegment(ax, ay, bx, by, m_x[i], m_y[i]) <= dd)
+		    ids.push_back(i);
+	    }
+	}
+    
+    std::sort(ids.begin(), ids.end());
+}
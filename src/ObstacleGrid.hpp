@@ -0,0 +1,130 @@
+/**
+ *@file ObstacleGrid.hpp
+ *@brief Uniform grid over the obstacle centers for radius queries
+ */
+
+#ifndef OBSTACLE_GRID_HPP_
+#define OBSTACLE_GRID_HPP_
+
+#include <vector>
+#include "ObstacleSet.hpp"
+
+/**
+ *@brief Squared distance from point [px, py] to the segment [ax, ay] - [bx, by]
+ */
+inline double SquaredDistanceToSegment(const double ax, const double ay, const double bx, const double by,
+				       const double px, const double py)
+{
+    const double ux = bx - ax;
+    const double uy = by - ay;
+    const double uu = ux * ux + uy * uy;
+    double       t  = uu > 0 ? ((px - ax) * ux + (py - ay) * uy) / uu : 0;
+    if(t < 0)
+	t = 0;
+    else if(t > 1)
+	t = 1;
+    
+    const double dx = ax + t * ux - px;
+    const double dy = ay + t * uy - py;
+    return dx * dx + dy * dy;
+}
+
+class ObstacleGrid
+{
+public:
+    ObstacleGrid(void);
+    
+    ~ObstacleGrid(void);
+
+    /**
+     *@brief Buckets the circular obstacles into a uniform grid
+     *
+     *@param cellSize edge length of a grid cell; if <= 0, it is picked from the
+     *       obstacle density so that a cell holds a handful of obstacles
+     */
+    void Build(const ObstacleSet &obstacles, const double cellSize = 0);
+
+    /**
+     *@brief Collects (in increasing order) the indices of all obstacles whose center
+     *       is within distance d of point [x, y] (up to rounding, so callers should
+     *       still apply their own exact test). Previous contents of ids are discarded.
+     */
+    void GetObstaclesWithinDist(const double x, const double y, const double d, std::vector<int> &ids) const;
+
+    /**
+     *@brief Same as GetObstaclesWithinDist, for the obstacles whose center is within
+     *       distance d of the segment [ax, ay] - [bx, by]. Only the cells overlapping
+     *       the bounding box of the segment, grown by d, are visited.
+     */
+    void GetObstaclesNearSegment(const double ax, const double ay, const double bx, const double by,
+				 const double d, std::vector<int> &ids) const;
+
+    double GetMaxRadius(void) const
+    {
+	return m_maxRadius;
+    }
+
+    double GetCellSize(void) const
+    {
+	return m_cellSize;
+    }
+
+    /**
+     * Grid layout, as stored in (or loaded from) a binary obstacle file
+     */
+    struct Layout
+    {
+	double minX;
+	double minY;
+	double cellSize;
+	double maxRadius;
+	int    nrCellsX;
+	int    nrCellsY;
+    };
+
+    Layout GetLayout(void) const;
+
+    /**
+     *@brief Cell c holds obstacles GetCellIds()[GetCellStarts()[c]] ... GetCellIds()[GetCellStarts()[c + 1] - 1];
+     *       there are nrCellsX * nrCellsY + 1 cell starts and one id per obstacle
+     */
+    const int* GetCellStarts(void) const
+    {
+	return m_cellStart;
+    }
+
+    const int* GetCellIds(void) const
+    {
+	return m_cellIds;
+    }
+
+    /**
+     *@brief Uses a grid built earlier (e.g. stored in a memory-mapped file) without copying it.
+     *       The arrays must outlive the grid, as must the obstacles.
+     */
+    void SetView(const ObstacleSet &obstacles, const Layout &layout, const int cellStart[], const int cellIds[]);
+
+protected:
+    int GetCellX(const double x) const;
+    int GetCellY(const double y) const;
+
+    double m_minX;
+    double m_minY;
+    double m_cellSize;
+    double m_maxRadius;
+    int    m_nrCellsX;
+    int    m_nrCellsY;
+
+    //obstacle centers (the arrays of the obstacle set the grid was built from)
+    const double *m_x;
+    const double *m_y;
+
+    //cell c holds obstacles m_cellIds[m_cellStart[c]] ... m_cellIds[m_cellStart[c + 1] - 1];
+    //the arrays point either into the vectors below or into a mapped file
+    const int *m_cellStart;
+    const int *m_cellIds;
+    std::vector<int> m_ownedCellStart;
+    std::vector<int> m_ownedCellIds;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "ObstacleSet.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+//the AVX2 kernels are compiled with a target attribute and picked at run time,
+//so the same binary still runs (with the scalar kernels) on machines without AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OBSTACLE_SET_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static double* AlignedAlloc(const int n)
+{
+    void *ptr = NULL;
+#ifdef _WIN32
+    ptr = _aligned_malloc(n * sizeof(double), ObstacleSet::ALIGNMENT);
+#else
+    if(posix_memalign(&ptr, ObstacleSet::ALIGNMENT, n * sizeof(double)) != 0)
+	ptr = NULL;
+#endif
+    return (double *) ptr;
+}
+
+static void AlignedFree(double *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+ObstacleSet::ObstacleSet(void)
+{
+    m_x = m_y = m_r = NULL;
+    m_n = m_capacity = 0;
+    m_owned = true;
+}
+
+ObstacleSet::~ObstacleSet(void)
+{
+    if(m_owned)
+    {
+	AlignedFree(m_x);
+	AlignedFree(m_y);
+	AlignedFree(m_r);
+    }
+}
+
+void ObstacleSet::Clear(void)
+{
+    if(!m_owned)
+    {
+	m_x = m_y = m_r = NULL;
+	m_capacity = 0;
+	m_owned = true;
+    }
+    m_n = 0;
+}
+
+void ObstacleSet::SetView(double x[], double y[], double r[], const int n)
+{
+    Clear();
+    if(m_capacity > 0)
+    {
+	AlignedFree(m_x);
+	AlignedFree(m_y);
+	AlignedFree(m_r);
+    }
+    
+    m_x = x;
+    m_y = y;
+    m_r = r;
+    m_n = n;
+    m_capacity = n;
+    m_owned = false;
+}
+
+void ObstacleSet::Reserve(const int n)
+{
+    //a view is copied into our own storage before it can grow
+    if(n <= m_capacity && m_owned)
+	return;
+    
+    const int capacity = n > m_n ? n : m_n;
+    double   *x = AlignedAlloc(capacity);
+    double   *y = AlignedAlloc(capacity);
+    double   *r = AlignedAlloc(capacity);
+    if(m_n > 0)
+    {
+	memcpy(x, m_x, m_n * sizeof(double));
+	memcpy(y, m_y, m_n * sizeof(double));
+	memcpy(r, m_r, m_n * sizeof(double));
+    }
+    if(m_owned)
+    {
+	AlignedFree(m_x);
+	AlignedFree(m_y);
+	AlignedFree(m_r);
+    }
+    
+    m_x = x;
+    m_y = y;
+    m_r = r;
+    m_capacity = capacity;
+    m_owned = true;
+}
+
+void ObstacleSet::AddObstacle(const double x, const double y, const double r)
+{
+    if(m_n == m_capacity || !m_owned)
+	Reserve(m_capacity < 16 ? 16 : 2 * m_capacity);
+    m_x[m_n] = x;
+    m_y[m_n] = y;
+    m_r[m_n] = r;
+    m_n++;
+}
+
+static inline void ClosestPointAtMaxDist(const double cx, const double cy, const double r,
+					 const double x, const double y, const double dist,
+					 double *px, double *py, double *d)
+{
+    //same operations, in the same order, as ManipSimulator::ClosestPointOnObstacleAtMaxDist
+    const double dd = sqrt((cx - x) * (cx - x) + (cy - y) * (cy - y));
+    
+    *d = dd;
+    if(dd <= dist)
+    {
+	*px = cx + r * (x - cx) / dd;
+	*py = cy + r * (y - cy) / dd;
+    }
+    else
+    {
+	*px = HUGE_VAL;
+	*py = HUGE_VAL;
+    }
+}
+
+#ifdef OBSTACLE_SET_AVX2
+
+static bool HasAVX2(void)
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+//4 obstacles at a time; no FMA, so every lane rounds exactly like the scalar code
+__attribute__((target("avx2")))
+static inline void ClosestPointsAtMaxDist4(const __m256d cx, const __m256d cy, const __m256d r,
+					   const __m256d x, const __m256d y, const __m256d dist,
+					   double *px, double *py, double *d)
+{
+    const __m256d huge = _mm256_set1_pd(HUGE_VAL);
+    const __m256d dx   = _mm256_sub_pd(cx, x);
+    const __m256d dy   = _mm256_sub_pd(cy, y);
+    const __m256d dd   = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    const __m256d in   = _mm256_cmp_pd(dd, dist, _CMP_LE_OQ);
+    
+    const __m256d qx = _mm256_add_pd(cx, _mm256_div_pd(_mm256_mul_pd(r, _mm256_sub_pd(x, cx)), dd));
+    const __m256d qy = _mm256_add_pd(cy, _mm256_div_pd(_mm256_mul_pd(r, _mm256_sub_pd(y, cy)), dd));
+    
+    _mm256_storeu_pd(d,  dd);
+    _mm256_storeu_pd(px, _mm256_blendv_pd(huge, qx, in));
+    _mm256_storeu_pd(py, _mm256_blendv_pd(huge, qy, in));
+}
+
+__attribute__((target("avx2")))
+static int ClosestPointsAtMaxDistAVX2(const double cx[], const double cy[], const double cr[], const int n,
+				      const double x, const double y, const double dist,
+				      double px[], double py[], double d[])
+{
+    const __m256d vx    = _mm256_set1_pd(x);
+    const __m256d vy    = _mm256_set1_pd(y);
+    const __m256d vdist = _mm256_set1_pd(dist);
+    int i = 0;
+    
+    for(; i + 4 <= n; i += 4)
+	ClosestPointsAtMaxDist4(_mm256_load_pd(cx + i), _mm256_load_pd(cy + i), _mm256_load_pd(cr + i),
+				vx, vy, vdist, px + i, py + i, d + i);
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int ClosestPointsAtMaxDistAVX2(const double cx[], const double cy[], const double cr[],
+				      const int ids[], const int n,
+				      const double x, const double y, const double dist,
+				      double px[], double py[], double d[])
+{
+    const __m256d vx    = _mm256_set1_pd(x);
+    const __m256d vy    = _mm256_set1_pd(y);
+    const __m256d vdist = _mm256_set1_pd(dist);
+    int k = 0;
+    
+    for(; k + 4 <= n; k += 4)
+    {
+	const __m128i idx = _mm_loadu_si128((const __m128i *) (ids + k));
+	ClosestPointsAtMaxDist4(_mm256_i32gather_pd(cx, idx, 8), _mm256_i32gather_pd(cy, idx, 8),
+				_mm256_i32gather_pd(cr, idx, 8),
+				vx, vy, vdist, px + k, py + k, d + k);
+    }
+    return k;
+}
+
+#endif
+
+void ObstacleSet::ClosestPointsAtMaxDist(const double x, const double y, const double dist,
+					 double px[], double py[], double d[]) const
+{
+    int i = 0;
+    
+#ifdef OBSTACLE_SET_AVX2
+    if(HasAVX2())
+	i = ClosestPointsAtMaxDistAVX2(m_x, m_y, m_r, m_n, x, y, dist, px, py, d);
+#endif
+    
+    for(; i < m_n; ++i)
+	ClosestPointAtMaxDist(m_x[i], m_y[i], m_r[i], x, y, dist, &px[i], &py[i], &d[i]);
+}
+
+void ObstacleSet::ClosestPointsAtMaxDist(const double x, const double y, const double dist,
+					 const int ids[], const int n,
+					 double px[], double py[], double d[]) const
+{
+    int k = 0;
+    
+#ifdef OBSTACLE_SET_AVX2
+    if(HasAVX2())
+	k = ClosestPointsAtMaxDistAVX2(m_x, m_y, m_r, ids, n, x, y, dist, px, py, d);
+#endif
+    
+    for(; k < n; ++k)
+    {
+	const int i = ids[k];
+	ClosestPointAtMaxDist(m_x[i], m_y[i], m_r[i], x, y, dist, &px[k], &py[k], &d[k]);
+    }
+}
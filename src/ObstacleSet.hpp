@@ -0,0 +1,108 @@
+/**
+ *@file ObstacleSet.hpp
+ *@brief Circular obstacles stored as a structure of arrays, with batch
+ *       closest-point queries
+ */
+
+#ifndef OBSTACLE_SET_HPP_
+#define OBSTACLE_SET_HPP_
+
+class ObstacleSet
+{
+public:
+    ObstacleSet(void);
+    
+    ~ObstacleSet(void);
+
+    void Clear(void);
+
+    void Reserve(const int n);
+
+    void AddObstacle(const double x, const double y, const double r);
+
+    /**
+     *@brief Uses n obstacles stored elsewhere (e.g. in a memory-mapped file) without
+     *       copying them. The arrays must be ALIGNMENT-byte aligned and outlive this set
+     *       (or the next call to Clear/Reserve/AddObstacle, which copy them first).
+     */
+    void SetView(double x[], double y[], double r[], const int n);
+
+    void SetObstacle(const int i, const double x, const double y, const double r)
+    {
+	m_x[i] = x;
+	m_y[i] = y;
+	m_r[i] = r;
+    }
+
+    int GetNrObstacles(void) const
+    {
+	return m_n;
+    }
+
+    double GetCenterX(const int i) const
+    {
+	return m_x[i];
+    }
+
+    double GetCenterY(const int i) const
+    {
+	return m_y[i];
+    }
+
+    double GetRadius(const int i) const
+    {
+	return m_r[i];
+    }
+
+    /**
+     *@brief Arrays of obstacle centers and radii (each aligned to ALIGNMENT bytes)
+     */
+    const double* GetCentersX(void) const
+    {
+	return m_x;
+    }
+
+    const double* GetCentersY(void) const
+    {
+	return m_y;
+    }
+
+    const double* GetRadii(void) const
+    {
+	return m_r;
+    }
+
+    /**
+     *@brief For every obstacle i, writes into px[i], py[i] the closest point on obstacle i
+     *       to point [x, y] and into d[i] the distance from [x, y] to the obstacle center.
+     *       As in ManipSimulator::ClosestPointOnObstacleAtMaxDist, px[i] and py[i] are set
+     *       to HUGE_VAL when d[i] > dist. Results are identical to the scalar version.
+     */
+    void ClosestPointsAtMaxDist(const double x, const double y, const double dist,
+				double px[], double py[], double d[]) const;
+
+    /**
+     *@brief Same as above, but only for obstacles ids[0], ..., ids[n - 1]; the result for
+     *       obstacle ids[k] is written into px[k], py[k], d[k]
+     */
+    void ClosestPointsAtMaxDist(const double x, const double y, const double dist,
+				const int ids[], const int n,
+				double px[], double py[], double d[]) const;
+
+    enum { ALIGNMENT = 32 };
+
+protected:
+    double *m_x;
+    double *m_y;
+    double *m_r;
+    int     m_n;
+    int     m_capacity;
+    bool    m_owned;
+
+private:
+    //obstacle sets can be large, so they are not copied by accident
+    ObstacleSet(const ObstacleSet &);
+    ObstacleSet& operator=(const ObstacleSet &);
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "PlannerBenchmark.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+//keeps the compiler from dropping the results of the timed calls
+static volatile double g_sink = 0;
+
+BenchmarkParameters::BenchmarkParameters(void)
+{
+    minSeconds  = 0.2;
+    repetitions = 5;
+    warmupTicks = 200;
+    tickSamples = 200;
+    maxTicks    = 20000;
+}
+
+static double Now(void)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Times body (which does callsPerRun calls of the kernel) in batches that
+ * double until each repetition lasts minSeconds / repetitions
+ */
+template <typename Body>
+static void Measure(Body body, const long callsPerRun, const BenchmarkParameters &params, BenchmarkResult &result)
+{
+    const double        budget = params.minSeconds / std::max(1, params.repetitions);
+    std::vector<double> ns;
+    result.calls = 0;
+
+    for(int r = 0; r < std::max(1, params.repetitions); ++r)
+    {
+	long   runs    = 0;
+	long   batch   = 1;
+	double elapsed = 0;
+	while(elapsed < budget)
+	{
+	    const double start = Now();
+	    for(long b = 0; b < batch; ++b)
+		body();
+	    elapsed += Now() - start;
+	    runs    += batch;
+	    batch   *= 2;
+	}
+	ns.push_back(1e9 * elapsed / (runs * callsPerRun));
+	result.calls += runs * callsPerRun;
+    }
+
+    std::sort(ns.begin(), ns.end());
+    result.nsPerCall    = ns[ns.size() / 2];
+    result.minNsPerCall = ns[0];
+}
+
+static BenchmarkResult MakeResult(const std::string &name, const Anatomy &anatomy, const int nrLinks,
+				  const double linkLength, const char benchmark[])
+{
+    BenchmarkResult result;
+    result.anatomy      = name;
+    result.nrObstacles  = anatomy.GetNrObstacles();
+    result.nrLinks      = nrLinks;
+    result.linkLength   = linkLength;
+    result.benchmark    = benchmark;
+    result.calls        = 0;
+    result.nsPerCall    = 0;
+    result.minNsPerCall = 0;
+    result.completed    = -1;
+    return result;
+}
+
+void PlannerBenchmark::RunKernels(const std::string &name, const Anatomy &anatomy, const int nrLinks, const double linkLength,
+				  const BenchmarkParameters &params, std::vector<BenchmarkResult> &results)
+{
+    ManipSimulator simulator(&anatomy);
+    ManipPlanner   planner(&simulator);
+    simulator.SetupLinks(nrLinks, linkLength);
+
+    //the kernels are timed on the configuration reached after the warmup
+    ::RunInsertion(&planner, &simulator, params.warmupTicks);
+    planner.ReserveWorkspace(nrLinks);
+
+    BenchmarkResult result = MakeResult(name, anatomy, nrLinks, linkLength, "fk");
+    Measure([&]() { simulator.MarkJointDirty(0); simulator.FK(); g_sink += simulator.GetLinkEndX(nrLinks - 1); },
+	    1, params, result);
+    results.push_back(result);
+
+    const int    n    = simulator.GetNrObstacles();
+    const double tipX = simulator.GetLinkEndX(nrLinks - 1);
+    const double tipY = simulator.GetLinkEndY(nrLinks - 1);
+    result = MakeResult(name, anatomy, nrLinks, linkLength, "closest_point");
+    Measure([&]() {
+	    for(int i = 0; i < n; ++i)
+		g_sink += simulator.ClosestPointOnObstacleAtMaxDist(i, tipX, tipY, planner.MAX_OCT_DEPTH).m_x;
+	}, std::max(1, n), params, result);
+    results.push_back(result);
+
+    result = MakeResult(name, anatomy, nrLinks, linkLength, "scan_oct");
+    Measure([&]() { planner.ScanOCT(planner.oct); }, 1, params, result);
+    results.push_back(result);
+
+    result = MakeResult(name, anatomy, nrLinks, linkLength, "collision_check");
+    Measure([&]() { planner.CollisionChecker(); }, 1, params, result);
+    results.push_back(result);
+
+    planner.BuildJacobians();
+    result = MakeResult(name, anatomy, nrLinks, linkLength, "repulsive_csf");
+    Measure([&]() {
+	    for(int j = 0; j < nrLinks; ++j)
+		planner.RepulsiveCSFAtLink(j, &planner.linkCSF[0]);
+	    g_sink += planner.linkCSF[0];
+	}, nrLinks, params, result);
+    results.push_back(result);
+
+    //every repetition replays the same ticks from a fresh warmed-up insertion
+    result = MakeResult(name, anatomy, nrLinks, linkLength, "tick");
+    std::vector<double> ns;
+    for(int r = 0; r < std::max(1, params.repetitions); ++r)
+    {
+	ManipSimulator tickSimulator(&anatomy);
+	ManipPlanner   tickPlanner(&tickSimulator);
+	tickSimulator.SetupLinks(nrLinks, linkLength);
+	::RunInsertion(&tickPlanner, &tickSimulator, params.warmupTicks);
+
+	const InsertionResult timed = ::RunInsertion(&tickPlanner, &tickSimulator, params.tickSamples);
+	if(timed.ticks > 0)
+	{
+	    ns.push_back(1e9 * timed.wallSeconds / timed.ticks);
+	    result.calls += timed.ticks;
+	}
+    }
+    if(!ns.empty())
+    {
+	std::sort(ns.begin(), ns.end());
+	result.nsPerCall    = ns[ns.size() / 2];
+	result.minNsPerCall = ns[0];
+    }
+    results.push_back(result);
+}
+
+void PlannerBenchmark::RunInsertion(const std::string &name, const Anatomy &anatomy, const int nrLinks, const double linkLength,
+				    const BenchmarkParameters &params, std::vector<BenchmarkResult> &results)
+{
+    BenchmarkResult     result = MakeResult(name, anatomy, nrLinks, linkLength, "insertion");
+    std::vector<double> ns;
+    double              elapsed = 0;
+
+    //long (or stalled) insertions are run once, as they already exceed the budget
+    for(int r = 0; r < std::max(1, params.repetitions) && (r == 0 || elapsed < params.minSeconds); ++r)
+    {
+	ManipSimulator simulator(&anatomy);
+	ManipPlanner   planner(&simulator);
+	simulator.SetupLinks(nrLinks, linkLength);
+
+	const InsertionResult run = ::RunInsertion(&planner, &simulator, params.maxTicks);
+	ns.push_back(run.ticks > 0 ? 1e9 * run.wallSeconds / run.ticks : 0);
+	elapsed         += run.wallSeconds;
+	result.calls     = run.ticks;
+	result.completed = run.completed ? 1 : 0;
+    }
+
+    std::sort(ns.begin(), ns.end());
+    result.nsPerCall    = ns[ns.size() / 2];
+    result.minNsPerCall = ns[0];
+    results.push_back(result);
+}
+
+void WriteBenchmarkCSV(FILE *out, const std::vector<BenchmarkResult> &results)
+{
+    fprintf(out, "anatomy,obstacles,nLinks,linkLength,benchmark,calls,nsPerCall,minNsPerCall,callsPerSecond,completed\n");
+    for(int i = 0; i < (int) results.size(); ++i)
+    {
+	const BenchmarkResult &r = results[i];
+	fprintf(out, "%s,%d,%d,%g,%s,%ld,%.2f,%.2f,%.1f,%d\n", r.anatomy.c_str(), r.nrObstacles, r.nrLinks,
+		r.linkLength, r.benchmark.c_str(), r.calls, r.nsPerCall, r.minNsPerCall,
+		r.nsPerCall > 0 ? 1e9 / r.nsPerCall : 0.0, r.completed);
+    }
+}
+
+void WriteBenchmarkJSON(FILE *out, const std::vector<BenchmarkResult> &results)
+{
+    fprintf(out, "[\n");
+    for(int i = 0; i < (int) results.size(); ++i)
+    {
+	const BenchmarkResult &r = results[i];
+	fprintf(out, "  {\"anatomy\": \"%s\", \"obstacles\": %d, \"nLinks\": %d, \"linkLength\": %g, "
+		"\"benchmark\": \"%s\", \"calls\": %ld, \"nsPerCall\": %.2f, \"minNsPerCall\": %.2f, "
+		"\"callsPerSecond\": %.1f", r.anatomy.c_str(), r.nrObstacles, r.nrLinks, r.linkLength,
+		r.benchmark.c_str(), r.calls, r.nsPerCall, r.minNsPerCall, r.nsPerCall > 0 ? 1e9 / r.nsPerCall : 0.0);
+	if(r.completed >= 0)
+	    fprintf(out, ", \"completed\": %s", r.completed ? "true" : "false");
+	fprintf(out, "}%s\n", i + 1 < (int) results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+bool LoadBenchmarkCSV(const char fname[], std::vector<BenchmarkResult> &results)
+{
+    FILE *in = fopen(fname, "r");
+    if(in == NULL)
+    {
+	printf("error: cannot open benchmark results %s\n", fname);
+	return false;
+    }
+
+    char buffer[4096];
+    bool header = true;
+    results.clear();
+    while(fgets(buffer, sizeof(buffer), in))
+    {
+	if(header)
+	{
+	    header = false;
+	    continue;
+	}
+
+	//the anatomy names are paths, which may hold anything but commas
+	std::istringstream line(buffer);
+	std::string        field[10];
+	int                k = 0;
+	while(k < 10 && std::getline(line, field[k], ','))
+	    ++k;
+	if(k < 10)
+	    continue;
+
+	BenchmarkResult r;
+	r.anatomy      = field[0];
+	r.nrObstacles  = atoi(field[1].c_str());
+	r.nrLinks      = atoi(field[2].c_str());
+	r.linkLength   = atof(field[3].c_str());
+	r.benchmark    = field[4];
+	r.calls        = atol(field[5].c_str());
+	r.nsPerCall    = atof(field[6].c_str());
+	r.minNsPerCall = atof(field[7].c_str());
+	r.completed    = atoi(field[9].c_str());
+	results.push_back(r);
+    }
+    fclose(in);
+
+    return true;
+}
+
+int CompareBenchmarks(FILE *out, const std::vector<BenchmarkResult> &results,
+		      const std::vector<BenchmarkResult> &baseline, const double tolerance)
+{
+    char key[1024];
+    std::map<std::string, const BenchmarkResult*> previous;
+    for(int i = 0; i < (int) baseline.size(); ++i)
+    {
+	const BenchmarkResult &b = baseline[i];
+	snprintf(key, sizeof(key), "%s,%d,%g,%s", b.anatomy.c_str(), b.nrLinks, b.linkLength, b.benchmark.c_str());
+	previous[key] = &b;
+    }
+
+    int nrRegressions = 0;
+    for(int i = 0; i < (int) results.size(); ++i)
+    {
+	const BenchmarkResult &r = results[i];
+	snprintf(key, sizeof(key), "%s,%d,%g,%s", r.anatomy.c_str(), r.nrLinks, r.linkLength, r.benchmark.c_str());
+	std::map<std::string, const BenchmarkResult*>::const_iterator it = previous.find(key);
+	if(it == previous.end() || it->second->nsPerCall <= 0)
+	    continue;
+
+	const double ratio = r.nsPerCall / it->second->nsPerCall;
+	if(ratio > 1 + tolerance)
+	{
+	    fprintf(out, "REGRESSION %s: %.2f ns -> %.2f ns per call (x%.2f)\n", key,
+		    it->second->nsPerCall, r.nsPerCall, ratio);
+	    nrRegressions++;
+	}
+    }
+
+    return nrRegressions;
+}
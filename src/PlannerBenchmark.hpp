@@ -0,0 +1,101 @@
+/**
+ *@file PlannerBenchmark.hpp
+ *@brief Timings of the simulator and planner hot paths (micro-benchmarks on a
+ *       warmed-up insertion) and of whole insertions, in a machine-readable
+ *       form that can be compared against an earlier run
+ */
+
+#ifndef PLANNER_BENCHMARK_HPP_
+#define PLANNER_BENCHMARK_HPP_
+
+#include "InsertionRunner.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct BenchmarkParameters
+{
+    BenchmarkParameters(void);
+
+    //time spent on each kernel, split over that many repetitions (the median
+    //and the fastest repetition are reported)
+    double minSeconds;
+    int    repetitions;
+
+    //ticks of the insertion run (untimed) before the kernels are timed, so
+    //that the OCT has sensed walls and the electrode is bending
+    int    warmupTicks;
+
+    //ticks timed per repetition of the "tick" benchmark
+    int    tickSamples;
+
+    //limit of the end-to-end insertion (some anatomies stall in the field)
+    int    maxTicks;
+};
+
+/**
+ * One row of results. The benchmarks are:
+ *   fk               ManipSimulator::FK of the whole chain (per call)
+ *   closest_point    ClosestPointOnObstacleAtMaxDist from the tip (per obstacle)
+ *   scan_oct         ManipPlanner::ScanOCT (per call)
+ *   collision_check  ManipPlanner::CollisionChecker (per call)
+ *   repulsive_csf    ManipPlanner::RepulsiveCSFAtLink (per link)
+ *   tick             ConfigurationMove + ApplyMove after the warmup (per tick)
+ *   insertion        a whole insertion from the start (per tick; completed
+ *                    tells whether it finished within maxTicks)
+ */
+struct BenchmarkResult
+{
+    std::string anatomy;
+    int         nrObstacles;
+    int         nrLinks;
+    double      linkLength;
+    std::string benchmark;
+    long        calls;
+    double      nsPerCall;
+    double      minNsPerCall;
+
+    //insertion only (-1 for the kernels)
+    int         completed;
+};
+
+class PlannerBenchmark
+{
+public:
+    /**
+     *@brief Times every kernel and the steady-state tick for one anatomy and
+     *       electrode, appending a row per benchmark
+     */
+    static void RunKernels(const std::string &name, const Anatomy &anatomy, const int nrLinks, const double linkLength,
+			   const BenchmarkParameters &params, std::vector<BenchmarkResult> &results);
+
+    /**
+     *@brief Times a whole insertion (ticks per second to full insertion)
+     */
+    static void RunInsertion(const std::string &name, const Anatomy &anatomy, const int nrLinks, const double linkLength,
+			     const BenchmarkParameters &params, std::vector<BenchmarkResult> &results);
+};
+
+/**
+ *@brief Writes the results as CSV (with a header line) or as a JSON array
+ */
+void WriteBenchmarkCSV(FILE *out, const std::vector<BenchmarkResult> &results);
+void WriteBenchmarkJSON(FILE *out, const std::vector<BenchmarkResult> &results);
+
+/**
+ *@brief Reads results written by WriteBenchmarkCSV; prints an error and returns
+ *       false on failure
+ */
+bool LoadBenchmarkCSV(const char fname[], std::vector<BenchmarkResult> &results);
+
+/**
+ *@brief Reports every benchmark whose median time per call grew by more than
+ *       tolerance (e.g. 0.25 for 25%) over the baseline row of the same
+ *       anatomy, electrode and benchmark
+ *
+ *@return number of regressions
+ */
+int CompareBenchmarks(FILE *out, const std::vector<BenchmarkResult> &results,
+		      const std::vector<BenchmarkResult> &baseline, const double tolerance);
+
+#endif
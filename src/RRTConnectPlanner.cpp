@@ -0,0 +1,615 @@
+#include "RRTConnectPlanner.hpp"
+#include "StepController.hpp"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <queue>
+
+RRTParameters::RRTParameters(void)
+{
+    seed               = 1;
+    nrTrees            = 4;
+    maxIterations      = 20000;
+    stepSize           = 0.5;
+    contactDistance    = CONTACT_DISTANCE;
+    memoResolution     = 0.25;
+    shortcutIterations = 200;
+    goalDepthRange     = 2;
+}
+
+void RRTConnectPlanner::Tree::Add(const RRTState &q, const int p)
+{
+    x.push_back(q.x);
+    y.push_back(q.y);
+    bend.push_back(q.bend);
+    parent.push_back(p);
+}
+
+RRTState RRTConnectPlanner::Tree::Get(const int i) const
+{
+    RRTState q;
+    q.x    = x[i];
+    q.y    = y[i];
+    q.bend = bend[i];
+    return q;
+}
+
+int RRTConnectPlanner::Tree::Nearest(const RRTState &q, const double bendWeight) const
+{
+    const int n    = x.size();
+    int       best = 0;
+    double    bestD2 = HUGE_VAL;
+    for(int i = 0; i < n; ++i)
+    {
+	const double dx = x[i] - q.x;
+	const double dy = y[i] - q.y;
+	const double db = (bend[i] - q.bend) * bendWeight;
+	const double d2 = dx * dx + dy * dy + db * db;
+	if(d2 < bestD2)
+	{
+	    bestD2 = d2;
+	    best   = i;
+	}
+    }
+    return best;
+}
+
+RRTConnectPlanner::RRTConnectPlanner(const ManipSimulator *simulator, const RRTParameters &params)
+{
+    m_params    = params;
+    m_obstacles = &simulator->GetObstacles();
+    m_grid      = &simulator->GetAnatomy()->GetGrid();
+    m_lengths   = simulator->GetLinkLengths();
+    m_memo      = new MemoShard[NR_MEMO_SHARDS];
+
+    //clearances beyond what an edge can use are not worth computing
+    m_memoCap   = params.contactDistance + 2 * (params.stepSize + params.memoResolution);
+
+    const int n = m_lengths.size();
+    m_electrodeLength = 0;
+    m_limits.resize(n);
+    for(int i = 0; i < n; ++i)
+    {
+	m_electrodeLength += m_lengths[i];
+	m_limits[i]        = simulator->GetLinkThetaLimit(i);
+    }
+
+    //ApplyMove fills the joints up to their (negative) limits from the tip
+    m_maxBend = 0;
+    for(int i = n - 1; i >= 0; --i)
+    {
+	m_maxBend -= m_limits[i];
+	m_bendBreaks.push_back(m_maxBend);
+    }
+
+    ElectrodeConfiguration config;
+    simulator->GetConfiguration(config);
+    m_start.x    = config.baseX;
+    m_start.y    = config.baseY;
+    m_start.bend = 0;
+    for(int i = 0; i < n; ++i)
+	m_start.bend -= config.joints[i];
+    m_startJoints = config.joints;
+
+    //the trees are sampled over the walls and the start
+    m_low  = m_start;
+    m_high = m_start;
+    const double *cx = m_obstacles->GetCentersX();
+    const double *cy = m_obstacles->GetCentersY();
+    for(int i = 0; i < m_obstacles->GetNrObstacles(); ++i)
+    {
+	m_low.x  = std::min(m_low.x, cx[i]);
+	m_low.y  = std::min(m_low.y, cy[i]);
+	m_high.x = std::max(m_high.x, cx[i]);
+	m_high.y = std::max(m_high.y, cy[i]);
+    }
+    m_low.x     -= 1;
+    m_low.y     -= 1;
+    m_high.x    += 1;
+    m_high.y    += 1;
+    m_low.bend  = 0;
+    m_high.bend = m_maxBend;
+
+    m_goalFree = ChooseGoals(simulator->GetGoalCenterX(), simulator->GetGoalCenterY());
+
+    m_stats.found = false;
+    m_stats.tree  = -1;
+}
+
+bool RRTConnectPlanner::ChooseGoals(const double goalX, const double goalY)
+{
+    //distance from the goal center through the free space (around the walls),
+    //by Dijkstra over the 8-connected cells of a grid covering the bounds
+    const double step = 0.5 * m_params.memoResolution;
+    const int    nx   = (int) ceil((m_high.x - m_low.x) / step) + 1;
+    const int    ny   = (int) ceil((m_high.y - m_low.y) / step) + 1;
+
+    std::vector<char> blocked(nx * ny, 0);
+    std::vector<int>  nearby;
+    const double *cx = m_obstacles->GetCentersX();
+    const double *cy = m_obstacles->GetCentersY();
+    const double *cr = m_obstacles->GetRadii();
+    for(int iy = 0; iy < ny; ++iy)
+	for(int ix = 0; ix < nx; ++ix)
+	{
+	    const double x = m_low.x + ix * step;
+	    const double y = m_low.y + iy * step;
+	    m_grid->GetObstaclesWithinDist(x, y, m_grid->GetMaxRadius(), nearby);
+	    for(int k = 0; k < (int) nearby.size() && !blocked[iy * nx + ix]; ++k)
+	    {
+		const int i = nearby[k];
+		blocked[iy * nx + ix] = (x - cx[i]) * (x - cx[i]) + (y - cy[i]) * (y - cy[i]) < cr[i] * cr[i];
+	    }
+	}
+
+    const int gx = (int) floor((goalX - m_low.x) / step + 0.5);
+    const int gy = (int) floor((goalY - m_low.y) / step + 0.5);
+    if(gx < 0 || gx >= nx || gy < 0 || gy >= ny)
+	return false;
+
+    std::vector<double> depth(nx * ny, HUGE_VAL);
+    std::priority_queue< std::pair<double, int>, std::vector< std::pair<double, int> >,
+			 std::greater< std::pair<double, int> > > open;
+    depth[gy * nx + gx] = 0;
+    open.push(std::make_pair(0.0, gy * nx + gx));
+    while(!open.empty())
+    {
+	const double d = open.top().first;
+	const int    c = open.top().second;
+	open.pop();
+	if(d > depth[c])
+	    continue;
+	for(int dy = -1; dy <= 1; ++dy)
+	    for(int dx = -1; dx <= 1; ++dx)
+	    {
+		const int x = c % nx + dx;
+		const int y = c / nx + dy;
+		if((dx == 0 && dy == 0) || x < 0 || x >= nx || y < 0 || y >= ny || blocked[y * nx + x])
+		    continue;
+		const double e = d + step * sqrt((double) (dx * dx + dy * dy));
+		if(e < depth[y * nx + x])
+		{
+		    depth[y * nx + x] = e;
+		    open.push(std::make_pair(e, y * nx + x));
+		}
+	    }
+    }
+
+    //tip of the fully inserted electrode with its base at the origin
+    RRTState tip;
+    tip.x    = 0;
+    tip.y    = 0;
+    tip.bend = m_maxBend;
+    ElectrodeConfiguration config;
+    SetConfiguration(tip, config);
+    double angle = 0;
+    for(int i = 0; i < (int) m_lengths.size(); ++i)
+    {
+	angle += config.joints[i];
+	tip.x += m_lengths[i] * cos(angle);
+	tip.y += m_lengths[i] * sin(angle);
+    }
+
+    //the goals are the free fully inserted configurations whose tip is the
+    //closest to the goal center through the free space (within goalDepthRange
+    //of the closest one), ie, as deep into the cochlea as the electrode fits
+    Worker w;
+    SetupWorker(w);
+    std::vector<double> goalDepths;
+    double   best = HUGE_VAL;
+    RRTState q;
+    q.bend = m_maxBend;
+    m_goals.clear();
+    for(int iy = 0; iy < ny; ++iy)
+	for(int ix = 0; ix < nx; ++ix)
+	{
+	    q.x = m_low.x + ix * step;
+	    q.y = m_low.y + iy * step;
+	    const int tx = (int) floor((q.x + tip.x - m_low.x) / step + 0.5);
+	    const int ty = (int) floor((q.y + tip.y - m_low.y) / step + 0.5);
+	    if(tx < 0 || tx >= nx || ty < 0 || ty >= ny || depth[ty * nx + tx] > best + m_params.goalDepthRange)
+		continue;
+	    if(Clearance(w, q) > m_params.contactDistance)
+	    {
+		best = std::min(best, depth[ty * nx + tx]);
+		m_goals.push_back(q);
+		goalDepths.push_back(depth[ty * nx + tx]);
+	    }
+	}
+
+    //drop the ones found before the closest one that are out of range
+    int nrGoals = 0;
+    for(int k = 0; k < (int) m_goals.size(); ++k)
+	if(goalDepths[k] <= best + m_params.goalDepthRange)
+	    m_goals[nrGoals++] = m_goals[k];
+    m_goals.resize(nrGoals);
+
+    return nrGoals > 0;
+}
+
+RRTConnectPlanner::~RRTConnectPlanner(void)
+{
+    delete[] m_memo;
+}
+
+double RRTConnectPlanner::Distance(const RRTState &a, const RRTState &b) const
+{
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double db = (b.bend - a.bend) * m_electrodeLength;
+    return sqrt(dx * dx + dy * dy + db * db);
+}
+
+void RRTConnectPlanner::SetupWorker(Worker &w) const
+{
+    const int n = m_lengths.size();
+    w.sweep.SetWalls(*m_obstacles, m_grid);
+    w.sweep.Reserve(n, m_obstacles->GetNrObstacles());
+    w.x.resize(n + 1);
+    w.y.resize(n + 1);
+    w.nearby.reserve(m_obstacles->GetNrObstacles());
+    w.iterations  = 0;
+    w.edgeChecks  = 0;
+    w.memoEdges   = 0;
+    w.memoLookups = 0;
+    w.memoHits    = 0;
+}
+
+void RRTConnectPlanner::SetConfiguration(const RRTState &q, ElectrodeConfiguration &config) const
+{
+    const int n = m_lengths.size();
+    config.baseX = q.x;
+    config.baseY = q.y;
+    config.joints.assign(n, 0.0);
+
+    //fill the joints up to their limits from the tip
+    double bend = q.bend;
+    for(int i = n - 1; i >= 0 && bend > 0; --i)
+    {
+	const double take = std::min(bend, -m_limits[i]);
+	config.joints[i]  = -take;
+	bend             -= take;
+    }
+}
+
+double RRTConnectPlanner::Clearance(Worker &w, const RRTState &q)
+{
+    const int n = m_lengths.size();
+    SetConfiguration(q, w.probe);
+
+    double angle = 0;
+    w.x[0] = q.x;
+    w.y[0] = q.y;
+    for(int i = 0; i < n; ++i)
+    {
+	angle     += w.probe.joints[i];
+	w.x[i + 1] = w.x[i] + m_lengths[i] * cos(angle);
+	w.y[i + 1] = w.y[i] + m_lengths[i] * sin(angle);
+    }
+
+    const double *cx = m_obstacles->GetCentersX();
+    const double *cy = m_obstacles->GetCentersY();
+    const double *cr = m_obstacles->GetRadii();
+
+    double clearance = m_memoCap;
+    for(int j = 0; j < n; ++j)
+    {
+	m_grid->GetObstaclesNearSegment(w.x[j], w.y[j], w.x[j + 1], w.y[j + 1],
+					clearance + m_grid->GetMaxRadius(), w.nearby);
+	for(int k = 0; k < (int) w.nearby.size(); ++k)
+	{
+	    const int    i     = w.nearby[k];
+	    const double reach = clearance + cr[i];
+	    const double d2    = SquaredDistanceToSegment(w.x[j], w.y[j], w.x[j + 1], w.y[j + 1], cx[i], cy[i]);
+	    if(reach > 0 && d2 >= reach * reach)
+		continue;
+
+	    const double d = sqrt(d2) - cr[i];
+	    if(d < clearance)
+		clearance = d;
+	}
+    }
+    return clearance;
+}
+
+double RRTConnectPlanner::MemoClearanceBound(Worker &w, const RRTState &q)
+{
+    //cells are cubes of the metric of Distance
+    const double    res = m_params.memoResolution;
+    const long long ix  = (long long) floor(q.x / res);
+    const long long iy  = (long long) floor(q.y / res);
+    const long long ib  = (long long) floor(q.bend * m_electrodeLength / res);
+
+    RRTState center;
+    center.x    = (ix + 0.5) * res;
+    center.y    = (iy + 0.5) * res;
+    center.bend = std::min(std::max((ib + 0.5) * res / m_electrodeLength, 0.0), m_maxBend);
+
+    const long long key = ((ix & 0x1FFFFF) << 42) | ((iy & 0x1FFFFF) << 21) | (ib & 0x1FFFFF);
+    MemoShard &shard = m_memo[((unsigned long long) key * 0x9E3779B97F4A7C15ULL) >> 58];
+
+    w.memoLookups++;
+    double clearance;
+    bool   found;
+    {
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	std::unordered_map<long long, double>::const_iterator it = shard.clearance.find(key);
+	found = it != shard.clearance.end();
+	if(found)
+	    clearance = it->second;
+    }
+    if(found)
+	w.memoHits++;
+    else
+    {
+	//two threads may both compute a cell; they store the same value
+	clearance = Clearance(w, center);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	shard.clearance[key] = clearance;
+    }
+
+    //no point of the electrode is farther than the step reach from where it
+    //is at the center of the cell
+    return clearance - StepReach(q.x - center.x, q.y - center.y, q.bend - center.bend, m_electrodeLength);
+}
+
+bool RRTConnectPlanner::IsEdgeFree(Worker &w, const RRTState &a, const RRTState &b)
+{
+    w.edgeChecks++;
+
+    //far from the walls, the memo settles the edge without a collision query
+    const double reach = StepReach(b.x - a.x, b.y - a.y, b.bend - a.bend, m_electrodeLength);
+    if(MemoClearanceBound(w, a) - reach > m_params.contactDistance)
+    {
+	w.memoEdges++;
+	return true;
+    }
+
+    //between two bends where a joint reaches its limit, every joint angle is
+    //linear in the bend, so the swept check (which interpolates the joints
+    //linearly) follows the electrode exactly on each piece
+    const double db = b.bend - a.bend;
+    const int    nb = m_bendBreaks.size();
+    SetConfiguration(a, w.from);
+    for(int k = 0; k <= nb; ++k)
+    {
+	double t = 1;
+	if(k < nb)
+	{
+	    const double brk = db > 0 ? m_bendBreaks[k] : m_bendBreaks[nb - 1 - k];
+	    if(db == 0 || (brk - a.bend) * db <= 0 || (b.bend - brk) * db <= 0)
+		continue;
+	    t = (brk - a.bend) / db;
+	}
+
+	RRTState q;
+	q.x    = a.x + t * (b.x - a.x);
+	q.y    = a.y + t * (b.y - a.y);
+	q.bend = a.bend + t * db;
+	SetConfiguration(q, w.to);
+	if(w.sweep.TimeOfFirstContact(m_lengths, w.from, w.to, m_params.contactDistance) <= 1)
+	    return false;
+	std::swap(w.from, w.to);
+    }
+    return true;
+}
+
+RRTState RRTConnectPlanner::Sample(Worker &w)
+{
+    RRTState q;
+    q.x    = m_low.x + Uniform(w.random) * (m_high.x - m_low.x);
+    q.y    = m_low.y + Uniform(w.random) * (m_high.y - m_low.y);
+    q.bend = m_low.bend + Uniform(w.random) * (m_high.bend - m_low.bend);
+    return q;
+}
+
+RRTConnectPlanner::ExtendResult RRTConnectPlanner::Extend(Worker &w, Tree &tree, const RRTState &q)
+{
+    const int      nearest = tree.Nearest(q, m_electrodeLength);
+    const RRTState from    = tree.Get(nearest);
+    const double   d       = Distance(from, q);
+
+    RRTState     to     = q;
+    ExtendResult result = REACHED;
+    if(d > m_params.stepSize)
+    {
+	const double s = m_params.stepSize / d;
+	to.x    = from.x + s * (q.x - from.x);
+	to.y    = from.y + s * (q.y - from.y);
+	to.bend = from.bend + s * (q.bend - from.bend);
+	result  = ADVANCED;
+    }
+
+    if(!IsEdgeFree(w, from, to))
+	return TRAPPED;
+    tree.Add(to, nearest);
+    return result;
+}
+
+RRTConnectPlanner::ExtendResult RRTConnectPlanner::Connect(Worker &w, Tree &tree, const RRTState &q)
+{
+    ExtendResult result;
+    do
+	result = Extend(w, tree, q);
+    while(result == ADVANCED);
+    return result;
+}
+
+void RRTConnectPlanner::GrowTrees(const int k)
+{
+    Worker &w = m_workers[k];
+    w.random.seed(m_params.seed + k);
+    w.trees[0].Add(m_start, -1);
+    for(int g = 0; g < (int) m_goals.size(); ++g)
+	w.trees[1].Add(m_goals[g], -1);
+
+    for(int iter = 0; iter < m_params.maxIterations; ++iter)
+    {
+	//a lower pair has connected: its path is the one used
+	if(m_solvedBy.load() < k)
+	    return;
+	w.iterations++;
+
+	//the trees take turns at extending toward the sample; the other one
+	//then tries to connect to the new node
+	Tree &a = w.trees[iter & 1];
+	Tree &b = w.trees[1 - (iter & 1)];
+	if(Extend(w, a, Sample(w)) == TRAPPED)
+	    continue;
+	if(Connect(w, b, a.Get(a.x.size() - 1)) != REACHED)
+	    continue;
+
+	//both trees now end at the same node: walk back to the start root, then
+	//on to the goal root
+	w.path.clear();
+	for(int i = w.trees[0].x.size() - 1; i >= 0; i = w.trees[0].parent[i])
+	    w.path.push_back(w.trees[0].Get(i));
+	std::reverse(w.path.begin(), w.path.end());
+	for(int i = w.trees[1].parent[w.trees[1].x.size() - 1]; i >= 0; i = w.trees[1].parent[i])
+	    w.path.push_back(w.trees[1].Get(i));
+
+	int solved = m_solvedBy.load();
+	while(k < solved && !m_solvedBy.compare_exchange_weak(solved, k))
+	    ;
+	return;
+    }
+}
+
+void RRTConnectPlanner::Shortcut(Worker &w, std::vector<RRTState> &path)
+{
+    for(int it = 0; it < m_params.shortcutIterations && path.size() > 2; ++it)
+    {
+	int i = (int) (Uniform(w.random) * path.size());
+	int j = (int) (Uniform(w.random) * path.size());
+	if(i > j)
+	    std::swap(i, j);
+	if(j - i < 2)
+	    continue;
+	if(IsEdgeFree(w, path[i], path[j]))
+	    path.erase(path.begin() + i + 1, path.begin() + j);
+    }
+}
+
+void RRTConnectPlanner::MakeMoves(const std::vector<RRTState> &path, InsertionTrajectory &trajectory) const
+{
+    trajectory.moves.clear();
+
+    //the joint angles as ApplyMove will leave them
+    const int n = m_lengths.size();
+    std::vector<double> joints = m_startJoints;
+
+    for(int p = 1; p < (int) path.size(); ++p)
+    {
+	const RRTState &a  = path[p - 1];
+	const RRTState &b  = path[p];
+	const double    db = b.bend - a.bend;
+
+	//the edge is cut where a joint reaches its limit, as in IsEdgeFree
+	double t0 = 0;
+	for(int k = 0; k <= n; ++k)
+	{
+	    double t1 = 1;
+	    if(k < n)
+	    {
+		const double brk = db > 0 ? m_bendBreaks[k] : m_bendBreaks[n - 1 - k];
+		if(db == 0 || (brk - a.bend) * db <= 0 || (b.bend - brk) * db <= 0)
+		    continue;
+		t1 = (brk - a.bend) / db;
+	    }
+	    const bool toLimit = db > 0 && (k < n || b.bend >= m_maxBend);
+
+	    const double dx = (t1 - t0) * (b.x - a.x);
+	    const double dy = (t1 - t0) * (b.y - a.y);
+	    const double dd = (t1 - t0) * db;
+	    t0 = t1;
+
+	    //as many ticks as the largest of the step caps asks for
+	    const double ticks = std::max(std::max(fabs(dx), fabs(dy)) / BASE_STEP, fabs(dd) / THETA_STEP);
+	    const int    nrMoves = std::max(1, (int) ceil(ticks));
+
+	    InsertionMove move;
+	    move.baseDeltaX = dx / nrMoves;
+	    move.baseDeltaY = dy / nrMoves;
+	    for(int m = 0; m < nrMoves; ++m)
+	    {
+		move.deltaTheta = -dd / nrMoves;
+
+		//a move that fills a joint past its limit hands the next joint
+		//more than the rest of the move (see ManipSimulator::SpreadBend),
+		//so the last move of the piece puts the joint exactly on its limit
+		if(toLimit && m == nrMoves - 1)
+		{
+		    int i = n - 1;
+		    while(i > 0 && joints[i] <= m_limits[i])
+			--i;
+		    move.deltaTheta = -(joints[i] - m_limits[i]);
+		}
+
+		if(n > 0)
+		    ManipSimulator::SpreadBend(move.deltaTheta, &joints[0], &m_limits[0], n);
+		trajectory.moves.push_back(move);
+	    }
+	}
+    }
+}
+
+bool RRTConnectPlanner::Plan(InsertionTrajectory &trajectory, ThreadPool *pool)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    trajectory.moves.clear();
+    m_path.clear();
+    m_stats.found       = false;
+    m_stats.tree        = -1;
+    m_stats.iterations  = 0;
+    m_stats.nodes       = 0;
+    m_stats.edgeChecks  = 0;
+    m_stats.memoEdges   = 0;
+    m_stats.memoLookups = 0;
+    m_stats.memoHits    = 0;
+    m_stats.nrWaypoints = 0;
+    m_stats.seconds     = 0;
+
+    if(m_goalFree && m_params.nrTrees > 0)
+    {
+	m_workers.clear();
+	m_workers.resize(m_params.nrTrees);
+	for(int k = 0; k < m_params.nrTrees; ++k)
+	    SetupWorker(m_workers[k]);
+
+	m_solvedBy = INT_MAX;
+	if(pool)
+	    pool->ParallelFor(m_params.nrTrees, [this](int k) { GrowTrees(k); });
+	else
+	    for(int k = 0; k < m_params.nrTrees; ++k)
+		GrowTrees(k);
+
+	for(int k = 0; k < m_params.nrTrees; ++k)
+	{
+	    const Worker &w = m_workers[k];
+	    m_stats.iterations  += w.iterations;
+	    m_stats.nodes       += w.trees[0].x.size() + w.trees[1].x.size();
+	    m_stats.edgeChecks  += w.edgeChecks;
+	    m_stats.memoEdges   += w.memoEdges;
+	    m_stats.memoLookups += w.memoLookups;
+	    m_stats.memoHits    += w.memoHits;
+	}
+
+	const int k = m_solvedBy.load();
+	if(k < m_params.nrTrees)
+	{
+	    m_path = m_workers[k].path;
+	    Shortcut(m_workers[k], m_path);
+	    MakeMoves(m_path, trajectory);
+
+	    m_stats.found       = true;
+	    m_stats.tree        = k;
+	    m_stats.nrWaypoints = m_path.size();
+	}
+	m_workers.clear();
+    }
+
+    m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return m_stats.found;
+}
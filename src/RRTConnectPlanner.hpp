@@ -0,0 +1,266 @@
+/**
+ *@file RRTConnectPlanner.hpp
+ *@brief Sampling-based alternative to the potential field of ManipPlanner:
+ *       RRT-Connect over the base position and the bend of the electrode,
+ *       planning the whole insertion before it is played
+ */
+
+#ifndef RRT_CONNECT_PLANNER_HPP_
+#define RRT_CONNECT_PLANNER_HPP_
+
+#include "InsertionTrajectory.hpp"
+#include "ManipSimulator.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A configuration of the electrode for the sampling planner: base position and
+ * total bend. The joint angles follow from the bend as ManipSimulator::ApplyMove
+ * spreads it (joints filled up to their limits from the tip), so a bend of 0 is
+ * the straight electrode and the largest bend is the fully inserted one
+ * (retractionCoeff == -1).
+ */
+struct RRTState
+{
+    double x;
+    double y;
+    double bend;
+};
+
+struct RRTParameters
+{
+    RRTParameters(void);
+
+    //seed of the first pair of trees (pair k uses seed + k)
+    unsigned int seed;
+
+    //pairs of trees grown independently (on the threads of the pool, if any);
+    //the path of the lowest pair that connects is used, so the result does not
+    //depend on the number of threads
+    int nrTrees;
+
+    //samples per pair of trees before giving up
+    int maxIterations;
+
+    //largest extension of a tree, in the metric of RRTConnectPlanner::Distance
+    double stepSize;
+
+    //required distance between the electrode and every wall surface along the
+    //path (CONTACT_DISTANCE: the replay damages no cell)
+    double contactDistance;
+
+    //cell size of the clearance memo, in the metric of RRTConnectPlanner::Distance
+    double memoResolution;
+
+    //random shortcut attempts on the path found
+    int shortcutIterations;
+
+    //the goal tree is rooted at every free fully inserted configuration whose
+    //tip is within goalDepthRange of the deepest one (see ChooseGoalss)
+    double goalDepthRange;
+};
+
+struct RRTStatistics
+{
+    bool   found;
+
+    //pair of trees whose path was used (-1 if none)
+    int    tree;
+
+    //samples and tree nodes, over all pairs of trees
+    long   iterations;
+    long   nodes;
+
+    //edges checked, and how many of them the clearance memo alone proved free
+    long   edgeChecks;
+    long   memoEdges;
+
+    //memo lookups, and how many found the cell already computed
+    long   memoLookups;
+    long   memoHits;
+
+    int    nrWaypoints;
+    double seconds;
+};
+
+class RRTConnectPlanner
+{
+public:
+    /**
+     *@brief Plans for the electrode and the anatomy of the simulator, from its
+     *       current configuration. The simulator is only read, when the planner
+     *       is built; the links must be set up.
+     */
+    RRTConnectPlanner(const ManipSimulator *simulator, const RRTParameters &params = RRTParameters());
+
+    ~RRTConnectPlanner(void);
+
+    /**
+     *@brief Plans a collision-free path from the current configuration of the
+     *       simulator to the fully inserted electrode with its tip at the goal,
+     *       and turns it into moves within the step caps of the field planner
+     *       (BASE_STEP per base coordinate, THETA_STEP of bend per tick).
+     *
+     *@param pool if not NULL, the pairs of trees are grown on its threads
+     *@return false if no path was found (the trajectory is then empty)
+     */
+    bool Plan(InsertionTrajectory &trajectory, ThreadPool *pool = NULL);
+
+    const RRTStatistics& GetStatistics(void) const
+    {
+	return m_stats;
+    }
+
+    /**
+     *@brief Waypoints of the last path found, from the start to the goal
+     */
+    const std::vector<RRTState>& GetPath(void) const
+    {
+	return m_path;
+    }
+
+    /**
+     *@brief Distance used to grow the trees: Euclidean in (x, y, bend * electrode
+     *       length), so that a unit of bend weighs as much as the tip moves
+     */
+    double Distance(const RRTState &a, const RRTState &b) const;
+
+protected:
+    struct Tree
+    {
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> bend;
+	std::vector<int>    parent;
+
+	void Add(const RRTState &q, const int p);
+	RRTState Get(const int i) const;
+	int Nearest(const RRTState &q, const double bendWeight) const;
+    };
+
+    /**
+     * Per-thread state: collision scratch, random numbers, trees and counts
+     */
+    struct Worker
+    {
+	SweptCollision         sweep;
+	ElectrodeConfiguration from;
+	ElectrodeConfiguration to;
+	ElectrodeConfiguration probe;
+	std::vector<double>    x;
+	std::vector<double>    y;
+	std::vector<int>       nearby;
+	std::mt19937           random;
+	Tree                   trees[2];
+	std::vector<RRTState>  path;
+	long                   iterations;
+	long                   edgeChecks;
+	long                   memoEdges;
+	long                   memoLookups;
+	long                   memoHits;
+    };
+
+    enum ExtendResult
+    {
+	TRAPPED,
+	ADVANCED,
+	REACHED
+    };
+
+    /**
+     *@brief Picks the roots of the goal tree (m_goals) for the goal center: the
+     *       free fully inserted configurations whose tip is the closest to the
+     *       goal center through the free space
+     *
+     *@return false if the electrode does not fit anywhere fully inserted
+     */
+    bool ChooseGoals(const double goalX, const double goalY);
+
+    /**
+     *@brief Points the collision scratch of w at the walls
+     */
+    void SetupWorker(Worker &w) const;
+
+    /**
+     *@brief Grows pair of trees k until they connect, maxIterations run out or
+     *       a lower pair has connected
+     */
+    void GrowTrees(const int k);
+    ExtendResult Extend(Worker &w, Tree &tree, const RRTState &q);
+    ExtendResult Connect(Worker &w, Tree &tree, const RRTState &q);
+    RRTState Sample(Worker &w);
+
+    /**
+     *@brief Joint angles of the electrode bent by bend (as ApplyMove spreads it)
+     */
+    void SetConfiguration(const RRTState &q, ElectrodeConfiguration &config) const;
+
+    /**
+     *@brief True if the electrode stays at least contactDistance away from every
+     *       wall surface while moving from a to b (base and bend interpolated
+     *       linearly, as the moves that replay the edge do)
+     */
+    bool IsEdgeFree(Worker &w, const RRTState &a, const RRTState &b);
+
+    /**
+     *@brief Smallest distance (capped at m_memoCap) from the electrode at q to a
+     *       wall surface
+     */
+    double Clearance(Worker &w, const RRTState &q);
+
+    /**
+     *@brief Lower bound on the clearance at q, from the clearance at the center of
+     *       the memo cell of q (computed on the first lookup of the cell)
+     */
+    double MemoClearanceBound(Worker &w, const RRTState &q);
+
+    void Shortcut(Worker &w, std::vector<RRTState> &path);
+    void MakeMoves(const std::vector<RRTState> &path, InsertionTrajectory &trajectory) const;
+
+    static double Uniform(std::mt19937 &random)
+    {
+	return (random() + 0.5) / 4294967296.0;
+    }
+
+    RRTParameters       m_params;
+    const ObstacleSet  *m_obstacles;
+    const ObstacleGrid *m_grid;
+    std::vector<double> m_lengths;
+    std::vector<double> m_limits;
+    double              m_electrodeLength;
+
+    //bend at which each joint (from the tip) reaches its limit, the largest
+    //one being the fully inserted electrode
+    std::vector<double> m_bendBreaks;
+    double              m_maxBend;
+
+    RRTState            m_start;
+    std::vector<double> m_startJoints;
+    std::vector<RRTState> m_goals;
+    bool                m_goalFree;
+    RRTState            m_low;
+    RRTState            m_high;
+
+    //clearance memo: cell -> clearance at its center, in shards with a lock each
+    //so the threads rarely wait on each other
+    static const int NR_MEMO_SHARDS = 64;
+    struct MemoShard
+    {
+	std::mutex                            mutex;
+	std::unordered_map<long long, double> clearance;
+    };
+    MemoShard          *m_memo;
+    double              m_memoCap;
+
+    std::vector<Worker> m_workers;
+    std::atomic<int>    m_solvedBy;
+
+    std::vector<RRTState> m_path;
+    RRTStatistics         m_stats;
+};
+
+#endif
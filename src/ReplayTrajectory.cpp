@@ -0,0 +1,95 @@
+/**
+ *@file ReplayTrajectory.cpp
+ *@brief Replays a trajectory log (see TrajectoryLog.hpp) headless: reports
+ *       the ticks, the damage and the final pose, and can dump the poses as
+ *       CSV, without running the planner
+ */
+
+#include "TrajectoryLog.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+//tip of the electrode (same chain as ManipSimulator::FK: relative to the base, then offset)
+static void Tip(const std::vector<double> &lengths, const ElectrodeConfiguration &config, double &x, double &y)
+{
+    double angle = 0;
+    x = 0;
+    y = 0;
+    for(int i = 0; i < (int) lengths.size(); ++i)
+    {
+	angle += config.joints[i];
+	x     += lengths[i] * cos(angle);
+	y     += lengths[i] * sin(angle);
+    }
+    x += config.baseX;
+    y += config.baseY;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+	printf("missing arguments\n");
+	printf("  ReplayTrajectory <trajectory log> [--csv <file>] [--every <n>]\n");
+	return 0;
+    }
+
+    FILE *csv   = NULL;
+    int   every = 1;
+    for(int i = 2; i < argc; ++i)
+    {
+	if(strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+	{
+	    csv = fopen(argv[++i], "w");
+	    if(csv == NULL)
+	    {
+		printf("error: cannot write %s\n", argv[i]);
+		return 1;
+	    }
+	    fprintf(csv, "tick,stage,baseX,baseY,tipX,tipY,newlyDamaged\n");
+	}
+	else if(strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+	    every = std::max(1, atoi(argv[++i]));
+    }
+
+    TrajectoryReader reader;
+    if(!reader.Open(argv[1]))
+	return 1;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    TrajectoryFrame frame;
+    frame.tick   = 0;
+    frame.stage  = 0;
+    frame.config = reader.GetInitialConfiguration();
+
+    double tipX, tipY;
+    long   nrDamaged = 0;
+    while(reader.Next(frame))
+    {
+	nrDamaged += frame.newlyDamaged.size();
+	if(csv && frame.tick % every == 0)
+	{
+	    Tip(reader.GetLinkLengths(), frame.config, tipX, tipY);
+	    fprintf(csv, "%d,%d,%.17g,%.17g,%.17g,%.17g,%d\n", frame.tick, frame.stage,
+		    frame.config.baseX, frame.config.baseY, tipX, tipY, (int) frame.newlyDamaged.size());
+	}
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(csv)
+	fclose(csv);
+
+    Tip(reader.GetLinkLengths(), frame.config, tipX, tipY);
+    printf("LINKS: %d\n", reader.GetNrLinks());
+    printf("TICKS: %d\n", frame.tick);
+    printf("TOTAL CELLS DAMAGED: %ld\n", nrDamaged);
+    printf("PERCENT OF CELLS DAMAGED: %.2f%%\n", reader.GetNrObstacles() > 0 ? 100.0 * nrDamaged / reader.GetNrObstacles() : 0.0);
+    printf("FINAL BASE: %.17g %.17g\n", frame.config.baseX, frame.config.baseY);
+    printf("FINAL TIP: %.17g %.17g\n", tipX, tipY);
+    printf("REPLAY TIME: %.6f s\n", seconds);
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "SimulationSnapshot.hpp"
+
+SimulationSnapshot::SimulationSnapshot(void)
+{
+    tick         = 0;
+    stage        = 0;
+    tipX         = 0;
+    tipY         = 0;
+    nrOldDamaged = 0;
+}
+
+void SimulationSnapshot::Capture(ManipPlanner &planner, const DamageTracker &damage, const int tick)
+{
+    const ManipSimulator *sim = planner.m_manipSimulator;
+    const int             n   = sim->GetNrLinks();
+
+    this->tick  = tick;
+    this->stage = planner.GetStage();
+
+    linkX.resize(n + 1);
+    linkY.resize(n + 1);
+    linkX[0] = sim->GetLinkStartX(0);
+    linkY[0] = sim->GetLinkStartY(0);
+    for(int j = 0; j < n; ++j)
+    {
+	linkX[j + 1] = sim->GetLinkEndX(j);
+	linkY[j + 1] = sim->GetLinkEndY(j);
+    }
+
+    const Point tip = planner.GetElectrodeTip();
+    tipX = tip.m_x;
+    tipY = tip.m_y;
+
+    const std::vector<int> &cells = damage.GetDamagedCells();
+    if(damaged.size() > cells.size() || (!damaged.empty() && damaged.back() != cells[damaged.size() - 1]))
+	damaged.clear();
+    damaged.insert(damaged.end(), cells.begin() + damaged.size(), cells.end());
+    nrOldDamaged = damage.GetNrDamaged() - damage.GetNrNewlyDamaged();
+
+    sensed.assign(planner.sensedPoints.begin(), planner.sensedPoints.end());
+}
+
+SnapshotBuffer::SnapshotBuffer(void) : m_middle(1)
+{
+    m_back  = 0;
+    m_front = 2;
+}
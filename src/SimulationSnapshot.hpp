@@ -0,0 +1,97 @@
+/**
+ *@file SimulationSnapshot.hpp
+ *@brief State of the insertion published by the simulation thread for
+ *       drawing, through a lock-free triple buffer
+ */
+
+#ifndef SIMULATION_SNAPSHOT_HPP_
+#define SIMULATION_SNAPSHOT_HPP_
+
+#include "ManipPlanner.hpp"
+#include <atomic>
+#include <vector>
+
+/**
+ * Everything the display needs from one tick, copied out of the simulator
+ * and planner so it can be drawn while the next ticks run
+ */
+struct SimulationSnapshot
+{
+    SimulationSnapshot(void);
+
+    /**
+     *@brief Copies the state after a tick. The damaged cells only grow during
+     *       an insertion, so only the ones this snapshot does not have yet
+     *       are appended (the whole list is copied again after a reset).
+     */
+    void Capture(ManipPlanner &planner, const DamageTracker &damage, const int tick);
+
+    int tick;
+    int stage;
+
+    //start of the first link, then the end of every link (the joints are
+    //the starts of the links)
+    std::vector<double> linkX;
+    std::vector<double> linkY;
+    double              tipX;
+    double              tipY;
+
+    //cells damaged so far; the ones from nrOldDamaged on were scraped
+    //during the last tick
+    std::vector<int>    damaged;
+    int                 nrOldDamaged;
+
+    //wall cells sensed by the OCT during the last tick
+    std::vector<int>    sensed;
+};
+
+/**
+ * Triple buffer of snapshots for one writer and one reader: the writer fills
+ * its back buffer and swaps it with the middle one, the reader swaps its
+ * front buffer with the middle one when a newer snapshot is there. Neither
+ * side ever waits; the reader just keeps drawing its front buffer, and
+ * snapshots published faster than they are read are dropped.
+ */
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer(void);
+
+    /**
+     *@brief Buffer for the writer to fill before Publish
+     */
+    SimulationSnapshot& GetBack(void)
+    {
+	return m_snapshots[m_back];
+    }
+
+    void Publish(void)
+    {
+	m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /**
+     *@brief Latest published snapshot (the same one as before if nothing new
+     *       was published); valid until the next call
+     */
+    const SimulationSnapshot& GetFront(void)
+    {
+	if(m_middle.load(std::memory_order_relaxed) & FRESH)
+	    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+	return m_snapshots[m_front];
+    }
+
+protected:
+    static const int INDEX = 3;
+    static const int FRESH = 4;
+
+    SimulationSnapshot m_snapshots[3];
+    int                m_back;
+    int                m_front;
+
+    //index of the middle buffer, with FRESH set when the writer put it
+    //there and the reader has not taken it yet
+    std::atomic<int>   m_middle;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "StepController.hpp"
+#include "ObstacleGrid.hpp"
+#include <cmath>
+
+double SegmentClearance(const double ax, const double ay, const double bx, const double by,
+			const double x[], const double y[], const double r[], const int n,
+			double clearance)
+{
+    for(int k = 0; k < n; ++k)
+    {
+	//skip the square root unless the circle can be closer than clearance
+	const double reach = clearance + r[k];
+	const double d2    = SquaredDistanceToSegment(ax, ay, bx, by, x[k], y[k]);
+	if(reach > 0 && d2 >= reach * reach)
+	    continue;
+
+	const double d = sqrt(d2) - r[k];
+	if(d < clearance)
+	    clearance = d;
+    }
+    return clearance;
+}
+
+double StepReach(const double dx, const double dy, const double dtheta, const double electrodeLength)
+{
+    //the base moves every point by |[dx, dy]|; the joints change by |dtheta|
+    //in total and no point is farther than electrodeLength from a joint
+    return sqrt(dx * dx + dy * dy) + fabs(dtheta) * electrodeLength;
+}
+
+double AdaptiveStepScale(const double clearance, const double reachAtCaps, const double safety,
+			 const double minScale, const double maxScale)
+{
+    const double free = clearance - CONTACT_DISTANCE;
+    if(!(free > 0) || !(reachAtCaps > 0))
+	return minScale;
+
+    const double scale = safety * free / reachAtCaps;
+    if(scale < minScale)
+	return minScale;
+    return scale < maxScale ? scale : maxScale;
+}
@@ -0,0 +1,50 @@
+/**
+ *@file StepController.hpp
+ *@brief Step sizing for the adaptive stepping mode of the planner: the
+ *       fixed step caps of ConfigurationMove are scaled up by how far the
+ *       electrode is from the walls it has sensed
+ */
+
+#ifndef STEP_CONTROLLER_HPP_
+#define STEP_CONTROLLER_HPP_
+
+//distance from a wall surface at which the electrode scrapes it (see ManipPlanner::CollisionChecker)
+const double CONTACT_DISTANCE = 0.1;
+
+//fixed step caps of ConfigurationMove: forward creep in stage 0, and base
+//translation (per coordinate) and bend in stage 1
+const double CREEP_STEP = 0.03;
+const double BASE_STEP  = 0.05;
+const double THETA_STEP = 0.03;
+
+/**
+ *@brief Smallest distance from the segment [ax, ay] - [bx, by] to the surfaces
+ *       of the n circles (x[k], y[k], r[k]), or clearance if that is smaller
+ */
+double SegmentClearance(const double ax, const double ay, const double bx, const double by,
+			const double x[], const double y[], const double r[], const int n,
+			double clearance);
+
+/**
+ *@brief Upper bound on how far any point of an electrode of total length
+ *       electrodeLength moves when its base translates by [dx, dy] and
+ *       dtheta is spread over its joints (ManipSimulator::ApplyMove)
+ */
+double StepReach(const double dx, const double dy, const double dtheta, const double electrodeLength);
+
+/**
+ *@brief Factor by which the fixed caps of a step whose reach at the caps is
+ *       reachAtCaps are scaled: safety * free clearance / reachAtCaps, where the
+ *       free clearance is what is left of the clearance beyond the contact
+ *       distance, clamped to [minScale, maxScale]. Unless the clamp to minScale
+ *       applies, no point of the electrode can move more than safety * the free
+ *       clearance, so the step cannot bring it into contact with a sensed wall.
+ *
+ *@param clearance smallest distance from the electrode to a sensed wall surface
+ *@param minScale  smallest factor, so the electrode keeps moving in contact
+ *@param maxScale  largest factor, for free space
+ */
+double AdaptiveStepScale(const double clearance, const double reachAtCaps, const double safety,
+			 const double minScale, const double maxScale);
+
+#endif
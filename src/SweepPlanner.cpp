@@ -0,0 +1,51 @@
+/**
+ *@file SweepPlanner.cpp
+ *@brief Runs a parameter sweep of headless insertions on all cores and
+ *       writes one CSV row per run
+ */
+
+#include "SweepRunner.hpp"
+#include <cstring>
+
+int main(int argc, char **argv)
+{
+    //positional arguments, with the --lockstep flag allowed anywhere
+    std::vector<char*> args;
+    bool               lockstep = false;
+    for(int i = 1; i < argc; ++i)
+    {
+	if(strcmp(argv[i], "--lockstep") == 0)
+	    lockstep = true;
+	else
+	    args.push_back(argv[i]);
+    }
+    
+    if(args.size() < 1)
+    {
+	printf("missing arguments\n");		
+	printf("  SweepPlanner <sweep file> [output csv] [nrThreads] [--lockstep]\n");
+	return 0;		
+    }
+
+    SweepSpec spec;
+    if(!LoadSweepSpec(args[0], spec))
+	return 1;
+
+    ThreadPool pool(args.size() > 2 ? atoi(args[2]) : 0);
+    
+    std::vector<SweepRun> runs;
+    if(!RunSweep(spec, pool, runs, lockstep))
+	return 1;
+    
+    FILE *out = args.size() > 1 ? fopen(args[1], "w") : stdout;
+    if(out == NULL)
+    {
+	printf("error: cannot write %s\n", args[1]);
+	return 1;
+    }
+    WriteSweepResults(out, spec, runs);
+    if(out != stdout)
+	fclose(out);
+    
+    return 0;
+}
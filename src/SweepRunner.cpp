@@ -0,0 +1,195 @@
+#include "SweepRunner.hpp"
+#include "BatchSimulator.hpp"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+SweepSpec::SweepSpec(void)
+{
+    maxTicks = 0;
+}
+
+template <typename T>
+static void ReadValues(std::istringstream &line, std::vector<T> &values)
+{
+    T value;
+    values.clear();
+    while(line >> value)
+	values.push_back(value);
+}
+
+bool LoadSweepSpec(const char fname[], SweepSpec &spec)
+{
+    FILE *in = fopen(fname, "r");
+    if(in == NULL)
+    {
+	printf("error: cannot open sweep file %s\n", fname);
+	return false;
+    }
+    
+    char buffer[4096];
+    bool ok = true;
+    while(ok && fgets(buffer, sizeof(buffer), in))
+    {
+	std::istringstream line(buffer);
+	std::string        key;
+	
+	if(!(line >> key) || key[0] == '#')
+	    continue;
+	
+	if(key == "anatomy")
+	    ReadValues(line, spec.anatomies);
+	else if(key == "nLinks")
+	    ReadValues(line, spec.nrLinks);
+	else if(key == "linkLength")
+	    ReadValues(line, spec.linkLengths);
+	else if(key == "alpha")
+	    ReadValues(line, spec.alphas);
+	else if(key == "gamma")
+	    ReadValues(line, spec.gammas);
+	else if(key == "Q")
+	    ReadValues(line, spec.Qs);
+	else if(key == "beta")
+	    ReadValues(line, spec.betas);
+	else if(key == "MAX_OCT_DEPTH")
+	    ReadValues(line, spec.maxOCTDepths);
+	else if(key == "ANGLE_BANDWIDTH")
+	    ReadValues(line, spec.angleBandwidths);
+	else if(key == "maxTicks")
+	    line >> spec.maxTicks;
+	else
+	{
+	    printf("error: unknown sweep parameter %s\n", key.c_str());
+	    ok = false;
+	}
+    }
+    fclose(in);
+    
+    if(ok && (spec.anatomies.empty() || spec.nrLinks.empty() || spec.linkLengths.empty()))
+    {
+	printf("error: sweep needs at least one anatomy, nLinks and linkLength\n");
+	ok = false;
+    }
+    
+    return ok;
+}
+
+void ExpandSweep(const SweepSpec &spec, std::vector<SweepRun> &runs)
+{
+    const PlannerParameters defaults;
+    
+    //parameters that are not swept keep their default value
+    const std::vector<double> alphas     = spec.alphas.empty()          ? std::vector<double>(1, defaults.alpha)          : spec.alphas;
+    const std::vector<double> gammas     = spec.gammas.empty()          ? std::vector<double>(1, defaults.gamma)          : spec.gammas;
+    const std::vector<double> Qs         = spec.Qs.empty()              ? std::vector<double>(1, defaults.Q)              : spec.Qs;
+    const std::vector<double> betas      = spec.betas.empty()           ? std::vector<double>(1, defaults.beta)           : spec.betas;
+    const std::vector<double> depths     = spec.maxOCTDepths.empty()    ? std::vector<double>(1, defaults.maxOCTDepth)    : spec.maxOCTDepths;
+    const std::vector<double> bandwidths = spec.angleBandwidths.empty() ? std::vector<double>(1, defaults.angleBandwidth) : spec.angleBandwidths;
+    
+    runs.clear();
+    
+    SweepRun run;
+    for(int a = 0; a < (int) spec.anatomies.size(); ++a)
+     for(int n = 0; n < (int) spec.nrLinks.size(); ++n)
+      for(int l = 0; l < (int) spec.linkLengths.size(); ++l)
+       for(int i0 = 0; i0 < (int) alphas.size(); ++i0)
+	for(int i1 = 0; i1 < (int) gammas.size(); ++i1)
+	 for(int i2 = 0; i2 < (int) Qs.size(); ++i2)
+	  for(int i3 = 0; i3 < (int) betas.size(); ++i3)
+	   for(int i4 = 0; i4 < (int) depths.size(); ++i4)
+	    for(int i5 = 0; i5 < (int) bandwidths.size(); ++i5)
+	    {
+		run.anatomy               = a;
+		run.nrLinks               = spec.nrLinks[n];
+		run.linkLength            = spec.linkLengths[l];
+		run.params.alpha          = alphas[i0];
+		run.params.gamma          = gammas[i1];
+		run.params.Q              = Qs[i2];
+		run.params.beta           = betas[i3];
+		run.params.maxOCTDepth    = depths[i4];
+		run.params.angleBandwidth = bandwidths[i5];
+		memset(&run.result, 0, sizeof(run.result));
+		runs.push_back(run);
+	    }
+}
+
+//runs every group of runs sharing an electrode design as one lockstep batch
+static void RunSweepLockstep(const SweepSpec &spec, ThreadPool &pool, const std::vector<Anatomy*> &anatomies,
+			     std::vector<SweepRun> &runs)
+{
+    std::vector<bool> done(runs.size(), false);
+    
+    for(int first = 0; first < (int) runs.size(); ++first)
+    {
+	if(done[first])
+	    continue;
+	
+	BatchSimulator   batch(runs[first].nrLinks, runs[first].linkLength);
+	std::vector<int> members;
+	for(int i = first; i < (int) runs.size(); ++i)
+	    if(!done[i] && runs[i].nrLinks == runs[first].nrLinks && runs[i].linkLength == runs[first].linkLength)
+	    {
+		batch.AddInstance(anatomies[runs[i].anatomy], runs[i].params);
+		members.push_back(i);
+		done[i] = true;
+	    }
+	
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	batch.Run(spec.maxTicks, &pool);
+	const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	for(int k = 0; k < (int) members.size(); ++k)
+	{
+	    runs[members[k]].result             = batch.GetResult(k);
+	    runs[members[k]].result.wallSeconds = wallSeconds;
+	}
+    }
+}
+
+bool RunSweep(const SweepSpec &spec, ThreadPool &pool, std::vector<SweepRun> &runs, const bool lockstep)
+{
+    //each anatomy is loaded once and then only read by the workers
+    std::vector<Anatomy*> anatomies(spec.anatomies.size(), (Anatomy *) NULL);
+    bool ok = true;
+    for(int a = 0; a < (int) spec.anatomies.size(); ++a)
+    {
+	anatomies[a] = new Anatomy();
+	ok = anatomies[a]->LoadFromFile(spec.anatomies[a].c_str()) && ok;
+    }
+    
+    ExpandSweep(spec, runs);
+    
+    if(ok && lockstep)
+	RunSweepLockstep(spec, pool, anatomies, runs);
+    else if(ok)
+	pool.ParallelFor(runs.size(), [&](int i)
+	{
+	    SweepRun      &run = runs[i];
+	    ManipSimulator simulator(anatomies[run.anatomy]);
+	    ManipPlanner   planner(&simulator, run.params);
+	    
+	    simulator.SetupLinks(run.nrLinks, run.linkLength);
+	    run.result = RunInsertion(&planner, &simulator, spec.maxTicks);
+	});
+    
+    for(int a = 0; a < (int) anatomies.size(); ++a)
+	delete anatomies[a];
+    
+    return ok;
+}
+
+void WriteSweepResults(FILE *out, const SweepSpec &spec, const std::vector<SweepRun> &runs)
+{
+    fprintf(out, "anatomy,nLinks,linkLength,alpha,gamma,Q,beta,MAX_OCT_DEPTH,ANGLE_BANDWIDTH,"
+	    "completed,ticks,cellsDamaged,percentDamaged,wallSeconds\n");
+    for(int i = 0; i < (int) runs.size(); ++i)
+    {
+	const SweepRun &run = runs[i];
+	fprintf(out, "%s,%d,%g,%g,%g,%g,%g,%g,%g,%d,%d,%d,%.4f,%.6f\n",
+		spec.anatomies[run.anatomy].c_str(), run.nrLinks, run.linkLength,
+		run.params.alpha, run.params.gamma, run.params.Q, run.params.beta,
+		run.params.maxOCTDepth, run.params.angleBandwidth,
+		run.result.completed ? 1 : 0, run.result.ticks, run.result.totalCellsDamaged,
+		run.result.percentDamaged, run.result.wallSeconds);
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ *@file SweepRunner.hpp
+ *@brief Runs a grid of independent insertions (anatomies x electrode designs x
+ *       planner parameters) on a thread pool
+ */
+
+#ifndef SWEEP_RUNNER_HPP_
+#define SWEEP_RUNNER_HPP_
+
+#include "InsertionRunner.hpp"
+#include "ThreadPool.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Values to sweep over; every combination is one run. Read from a text file
+ * with one parameter per line followed by its values, e.g.
+ *
+ *   anatomy bin/cochlea_A915.txt bin/cochlea_A925.txt
+ *   nLinks 8 12
+ *   linkLength 1 0.75
+ *   alpha 0.8 1 1.2
+ *   maxTicks 5000
+ *
+ * Valid keys: anatomy, nLinks, linkLength, alpha, gamma, Q, beta,
+ * MAX_OCT_DEPTH, ANGLE_BANDWIDTH (radians) and maxTicks (single value).
+ * Parameters that are not listed keep the planner defaults. Lines starting
+ * with # are comments.
+ */
+struct SweepSpec
+{
+    SweepSpec(void);
+    
+    std::vector<std::string> anatomies;
+    std::vector<int>         nrLinks;
+    std::vector<double>      linkLengths;
+    std::vector<double>      alphas;
+    std::vector<double>      gammas;
+    std::vector<double>      Qs;
+    std::vector<double>      betas;
+    std::vector<double>      maxOCTDepths;
+    std::vector<double>      angleBandwidths;
+    int                      maxTicks;
+};
+
+struct SweepRun
+{
+    int               anatomy;   //index into SweepSpec::anatomies
+    int               nrLinks;
+    double            linkLength;
+    PlannerParameters params;
+    InsertionResult   result;
+};
+
+/**
+ *@brief Reads a sweep specification; prints an error and returns false on failure
+ */
+bool LoadSweepSpec(const char fname[], SweepSpec &spec);
+
+/**
+ *@brief Expands the spec into its runs (anatomy varies slowest, ANGLE_BANDWIDTH fastest)
+ */
+void ExpandSweep(const SweepSpec &spec, std::vector<SweepRun> &runs);
+
+/**
+ *@brief Loads every anatomy once and runs all the insertions on the pool;
+ *       the workers share the anatomies read-only
+ *
+ *@param lockstep if true, runs with the same electrode design are advanced together
+ *       by a BatchSimulator (same results; wallSeconds is then that of the whole batch)
+ *@return false if an anatomy file could not be loaded
+ */
+bool RunSweep(const SweepSpec &spec, ThreadPool &pool, std::vector<SweepRun> &runs, const bool lockstep = false);
+
+/**
+ *@brief Writes one CSV row per run (with a header line)
+ */
+void WriteSweepResults(FILE *out, const SweepSpec &spec, const std::vector<SweepRun> &runs);
+
+#endif
@@ -0,0 +1,202 @@
+#include "SweptCollision.hpp"
+#include <algorithm>
+#include <cmath>
+
+SweptCollision::SweptCollision(void)
+{
+    tolerance     = 1e-6;
+    maxIterations = 200;
+
+    m_wallX   = NULL;
+    m_wallY   = NULL;
+    m_wallR   = NULL;
+    m_nrWalls = 0;
+    m_grid    = NULL;
+}
+
+SweptCollision::~SweptCollision(void)
+{
+}
+
+void SweptCollision::Reserve(const int nrLinks, const int nrObstacles)
+{
+    m_x.reserve(nrLinks + 1);
+    m_y.reserve(nrLinks + 1);
+    m_nearby.reserve(nrObstacles);
+    m_candidates.reserve(nrObstacles);
+}
+
+void SweptCollision::SetWalls(const ObstacleSet &obstacles, const ObstacleGrid *grid)
+{
+    m_wallX   = obstacles.GetCentersX();
+    m_wallY   = obstacles.GetCentersY();
+    m_wallR   = obstacles.GetRadii();
+    m_nrWalls = obstacles.GetNrObstacles();
+    m_grid    = grid;
+}
+
+void SweptCollision::SetWalls(const double x[], const double y[], const double r[], const int n)
+{
+    m_wallX   = x;
+    m_wallY   = y;
+    m_wallR   = r;
+    m_nrWalls = n;
+    m_grid    = NULL;
+}
+
+void SweptCollision::Interpolate(const std::vector<double> &lengths,
+				 const ElectrodeConfiguration &from, const ElectrodeConfiguration &to, const double t)
+{
+    const int n = lengths.size();
+
+    double angle = 0;
+    m_x[0] = from.baseX + t * (to.baseX - from.baseX);
+    m_y[0] = from.baseY + t * (to.baseY - from.baseY);
+    for(int i = 0; i < n; ++i)
+    {
+	angle     += from.joints[i] + t * (to.joints[i] - from.joints[i]);
+	m_x[i + 1] = m_x[i] + lengths[i] * cos(angle);
+	m_y[i + 1] = m_y[i] + lengths[i] * sin(angle);
+    }
+}
+
+double SweptCollision::Clearance(const double maxDistance, int &closest)
+{
+    const int n         = m_x.size() - 1;
+    double    clearance = maxDistance;
+
+    for(int j = 0; j < n; ++j)
+    {
+	const double ax = m_x[j];
+	const double ay = m_y[j];
+	const double bx = m_x[j + 1];
+	const double by = m_y[j + 1];
+
+	//the walls whose surface can be within the current clearance of the link
+	const int *ids = NULL;
+	int        nrIds = m_nrWalls;
+	if(m_grid)
+	{
+	    m_grid->GetObstaclesNearSegment(ax, ay, bx, by, clearance + m_grid->GetMaxRadius(), m_nearby);
+	    ids   = m_nearby.empty() ? NULL : &m_nearby[0];
+	    nrIds = m_nearby.size();
+	}
+
+	for(int k = 0; k < nrIds; ++k)
+	{
+	    const int    i     = ids ? ids[k] : k;
+	    const double reach = clearance + m_wallR[i];
+	    const double d2    = SquaredDistanceToSegment(ax, ay, bx, by, m_wallX[i], m_wallY[i]);
+	    if(reach > 0 && d2 >= reach * reach)
+		continue;
+
+	    const double d = sqrt(d2) - m_wallR[i];
+	    if(d < clearance)
+	    {
+		clearance = d;
+		closest   = i;
+	    }
+	}
+    }
+
+    return clearance;
+}
+
+double SweptCollision::MaxSpeed(const std::vector<double> &lengths,
+				 const ElectrodeConfiguration &from, const ElectrodeConfiguration &to)
+{
+    //the base moves every point, and joint i swings the links after it about its start
+    double speed  = sqrt((to.baseX - from.baseX) * (to.baseX - from.baseX) +
+			 (to.baseY - from.baseY) * (to.baseY - from.baseY));
+    double distal = 0;
+    for(int i = (int) lengths.size() - 1; i >= 0; --i)
+    {
+	distal += lengths[i];
+	speed  += fabs(to.joints[i] - from.joints[i]) * distal;
+    }
+    return speed;
+}
+
+double SweptCollision::TimeOfFirstContact(const std::vector<double> &lengths,
+					  const ElectrodeConfiguration &from, const ElectrodeConfiguration &to,
+					  const double contactDistance, int *obstacle)
+{
+    const int n = lengths.size();
+    m_x.resize(n + 1);
+    m_y.resize(n + 1);
+
+    const double speed = MaxSpeed(lengths, from, to);
+
+    if(obstacle)
+	*obstacle = -1;
+
+    double t = 0;
+    for(int iter = 0; iter < maxIterations; ++iter)
+    {
+	Interpolate(lengths, from, to, t);
+
+	//walls farther than what is left of the sweep cannot be reached
+	const double remaining = speed * (1 - t);
+	int          closest   = -1;
+	const double free      = Clearance(contactDistance + remaining + tolerance, closest) - contactDistance;
+
+	if(free < tolerance)
+	{
+	    if(obstacle)
+		*obstacle = closest;
+	    return t;
+	}
+	if(free >= remaining)
+	    return HUGE_VAL;
+
+	//no point can cover the free clearance before this time
+	t += free / speed;
+    }
+
+    return t;
+}
+
+int SweptCollision::MarkContacts(const std::vector<double> &lengths,
+				 const ElectrodeConfiguration &from, const ElectrodeConfiguration &to,
+				 const ObstacleSet &obstacles, const ObstacleGrid &grid,
+				 const double contactDistance, DamageTracker &damage)
+{
+    const int n = lengths.size();
+    m_x.resize(n + 1);
+    m_y.resize(n + 1);
+
+    //every point stays within MaxSpeed of where it ends up, so only the walls
+    //that far from the final links can be touched during the move
+    const double reach = contactDistance + grid.GetMaxRadius() + MaxSpeed(lengths, from, to) + tolerance;
+    Interpolate(lengths, from, to, 1);
+
+    m_candidates.clear();
+    for(int j = 0; j < n; ++j)
+    {
+	grid.GetObstaclesNearSegment(m_x[j], m_y[j], m_x[j + 1], m_y[j + 1], reach, m_nearby);
+	m_candidates.insert(m_candidates.end(), m_nearby.begin(), m_nearby.end());
+    }
+    std::sort(m_candidates.begin(), m_candidates.end());
+    m_candidates.erase(std::unique(m_candidates.begin(), m_candidates.end()), m_candidates.end());
+
+    const double *x = obstacles.GetCentersX();
+    const double *y = obstacles.GetCentersY();
+    const double *r = obstacles.GetRadii();
+
+    int nrDamaged = 0;
+    for(int k = 0; k < (int) m_candidates.size(); ++k)
+    {
+	const int i = m_candidates[k];
+	if(damage.IsDamaged(i))
+	    continue;
+
+	SetWalls(&x[i], &y[i], &r[i], 1);
+	if(TimeOfFirstContact(lengths, from, to, contactDistance) <= 1)
+	{
+	    damage.MarkDamaged(i);
+	    nrDamaged++;
+	}
+    }
+
+    return nrDamaged;
+}
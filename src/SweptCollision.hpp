@@ -0,0 +1,125 @@
+/**
+ *@file SweptCollision.hpp
+ *@brief Continuous collision detection: time of first contact of the electrode
+ *       with the walls while it moves from one configuration to another
+ */
+
+#ifndef SWEPT_COLLISION_HPP_
+#define SWEPT_COLLISION_HPP_
+
+#include "DamageTracker.hpp"
+#include "ObstacleGrid.hpp"
+#include "ObstacleSet.hpp"
+#include <cstddef>
+#include <vector>
+
+/**
+ * Base position and joint angles of an electrode
+ */
+struct ElectrodeConfiguration
+{
+    double              baseX;
+    double              baseY;
+    std::vector<double> joints;
+};
+
+class SweptCollision
+{
+public:
+    SweptCollision(void);
+
+    ~SweptCollision(void);
+
+    /**
+     *@brief Tests against the obstacles of the set; with a grid built over the
+     *       same set, only the obstacles near the electrode are visited.
+     *       The set (and grid) must outlive the queries.
+     */
+    void SetWalls(const ObstacleSet &obstacles, const ObstacleGrid *grid);
+
+    /**
+     *@brief Tests against the n circles (x[k], y[k], r[k]), all of them visited
+     *       at every step. The arrays must outlive the queries.
+     */
+    void SetWalls(const double x[], const double y[], const double r[], const int n);
+
+    /**
+     *@brief Time t in [0, 1] at which the electrode with the given link lengths
+     *       first comes within contactDistance of a wall surface while moving
+     *       from configuration from (t = 0) to configuration to (t = 1), with
+     *       the base and every joint angle interpolated linearly.
+     *
+     *       Conservative advancement: at each step the electrode may advance by
+     *       its clearance divided by a bound on the speed of its points, so no
+     *       wall can be tunneled through however large the move is. The time
+     *       returned is never later than the actual first contact, and is
+     *       within tolerance (as a distance) of it unless maxIterations ran out.
+     *
+     *@param obstacle if not NULL, set to the wall hit (-1 if none)
+     *@return HUGE_VAL if there is no contact during the move, 0 if the electrode
+     *        is already in contact at from
+     */
+    double TimeOfFirstContact(const std::vector<double> &lengths,
+			      const ElectrodeConfiguration &from, const ElectrodeConfiguration &to,
+			      const double contactDistance, int *obstacle = NULL);
+
+    /**
+     *@brief Marks as damaged every obstacle of the set that the electrode comes
+     *       within contactDistance of at any time while moving from configuration
+     *       from to configuration to (each candidate found through the grid gets
+     *       its own time of first contact). Replaces the walls set by SetWalls.
+     *
+     *@return number of obstacles newly damaged
+     */
+    int MarkContacts(const std::vector<double> &lengths,
+		     const ElectrodeConfiguration &from, const ElectrodeConfiguration &to,
+		     const ObstacleSet &obstacles, const ObstacleGrid &grid,
+		     const double contactDistance, DamageTracker &damage);
+
+    /**
+     *@brief Bound on how fast (per unit of time) any point of the electrode
+     *       moves from configuration from to configuration to
+     */
+    static double MaxSpeed(const std::vector<double> &lengths,
+			   const ElectrodeConfiguration &from, const ElectrodeConfiguration &to);
+
+    /**
+     *@brief Sizes the buffers for nrLinks links and nrObstacles obstacles, so
+     *       that the queries do not allocate
+     */
+    void Reserve(const int nrLinks, const int nrObstacles);
+
+    //contact is reported when the clearance is below tolerance
+    double tolerance;
+
+    //advancement steps before giving up on a grazing contact
+    int    maxIterations;
+
+protected:
+    /**
+     *@brief Link positions at time t (m_x, m_y)
+     */
+    void Interpolate(const std::vector<double> &lengths,
+		     const ElectrodeConfiguration &from, const ElectrodeConfiguration &to, const double t);
+
+    /**
+     *@brief Smallest distance from the links (at the current m_x, m_y) to a wall
+     *       surface, considering only the walls within maxDistance
+     *
+     *@return maxDistance if no wall is closer
+     */
+    double Clearance(const double maxDistance, int &closest);
+
+    const double       *m_wallX;
+    const double       *m_wallY;
+    const double       *m_wallR;
+    int                 m_nrWalls;
+    const ObstacleGrid *m_grid;
+
+    std::vector<double> m_x;
+    std::vector<double> m_y;
+    std::vector<int>    m_nearby;
+    std::vector<int>    m_candidates;
+};
+
+#endif
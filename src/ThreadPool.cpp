@@ -0,0 +1,93 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(const int nrThreads)
+{
+    int n = nrThreads;
+    if(n <= 0)
+	n = std::thread::hardware_concurrency();
+    if(n <= 0)
+	n = 1;
+    
+    m_task       = NULL;
+    m_nrTasks    = 0;
+    m_next       = 0;
+    m_nrBusy     = 0;
+    m_generation = 0;
+    m_stop       = false;
+    
+    for(int i = 1; i < n; ++i)
+	m_workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool(void)
+{
+    {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stop = true;
+    }
+    m_wakeUp.notify_all();
+    for(int i = 0; i < (int) m_workers.size(); ++i)
+	m_workers[i].join();
+}
+
+void ThreadPool::RunTasks(void)
+{
+    for(int i = m_next++; i < m_nrTasks; i = m_next++)
+	(*m_task)(i);
+}
+
+void ThreadPool::WorkerLoop(void)
+{
+    unsigned long seen = 0;
+    
+    while(true)
+    {
+	{
+	    std::unique_lock<std::mutex> lock(m_mutex);
+	    m_wakeUp.wait(lock, [&]{ return m_stop || m_generation != seen; });
+	    if(m_stop)
+		return;
+	    seen = m_generation;
+	    m_nrBusy++;
+	}
+	
+	RunTasks();
+	
+	{
+	    std::lock_guard<std::mutex> lock(m_mutex);
+	    m_nrBusy--;
+	}
+	m_done.notify_all();
+    }
+}
+
+void ThreadPool::ParallelFor(const int n, const std::function<void(int)> &task)
+{
+    if(n <= 0)
+	return;
+    
+    if(m_workers.empty() || n == 1)
+    {
+	for(int i = 0; i < n; ++i)
+	    task(i);
+	return;
+    }
+    
+    {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_task    = &task;
+	m_nrTasks = n;
+	m_next    = 0;
+	m_generation++;
+    }
+    m_wakeUp.notify_all();
+    
+    RunTasks();
+    
+    //wait for the workers that picked up this job; workers that wake up
+    //late find no tasks left and do not touch m_task
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]{ return m_nrBusy == 0; });
+    m_task    = NULL;
+    m_nrTasks = 0;
+}
@@ -0,0 +1,57 @@
+/**
+ *@file ThreadPool.hpp
+ *@brief Persistent pool of worker threads running parallel-for loops
+ */
+
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    /**
+     *@param nrThreads total number of threads, including the thread calling ParallelFor;
+     *       if <= 0, it is set to the number of hardware threads of the machine
+     */
+    ThreadPool(const int nrThreads = 0);
+    
+    ~ThreadPool(void);
+
+    int GetNrThreads(void) const
+    {
+	return m_workers.size() + 1;
+    }
+
+    /**
+     *@brief Calls task(i) for i = 0, ..., n - 1, spread over the pool, and returns once
+     *       all calls are done. The calling thread takes part in the work.
+     *       Not reentrant: task must not call ParallelFor on the same pool.
+     */
+    void ParallelFor(const int n, const std::function<void(int)> &task);
+
+protected:
+    void WorkerLoop(void);
+    void RunTasks(void);
+
+    std::vector<std::thread>     m_workers;
+    std::mutex                   m_mutex;
+    std::condition_variable      m_wakeUp;
+    std::condition_variable      m_done;
+
+    //current job: tasks [0, m_nrTasks) of m_task, handed out through m_next
+    const std::function<void(int)> *m_task;
+    int                          m_nrTasks;
+    std::atomic<int>             m_next;
+    int                          m_nrBusy;
+    unsigned long                m_generation;
+    bool                         m_stop;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "TickProfiler.hpp"
+#include <chrono>
+#include <cstring>
+
+double CyclesPerNanosecond(void)
+{
+#ifdef TICK_PROFILER_RDTSC
+    //the counter against the steady clock over a few milliseconds
+    static const double rate = []() {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const uint64_t cycles = ReadCycleCounter();
+	std::chrono::steady_clock::time_point now;
+	do
+	    now = std::chrono::steady_clock::now();
+	while(now - start < std::chrono::milliseconds(10));
+	return (ReadCycleCounter() - cycles) / (double) std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+    }();
+    return rate;
+#else
+    return 1;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram(void)
+{
+    Reset();
+}
+
+void LatencyHistogram::Reset(void)
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_sum   = 0;
+    m_min   = UINT64_MAX;
+    m_max   = 0;
+}
+
+void LatencyHistogram::Add(const LatencyHistogram &other)
+{
+    for(int b = 0; b < NR_BUCKETS; ++b)
+	m_counts[b] += other.m_counts[b];
+    m_count += other.m_count;
+    m_sum   += other.m_sum;
+    if(other.m_min < m_min)
+	m_min = other.m_min;
+    if(other.m_max > m_max)
+	m_max = other.m_max;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(const int bucket)
+{
+    if(bucket < NR_LINEAR)
+	return bucket;
+    const int      e     = 6 + (bucket - NR_LINEAR) / SUB_BUCKETS;
+    const uint64_t sub   = (bucket - NR_LINEAR) % SUB_BUCKETS;
+    const uint64_t lower = (SUB_BUCKETS + sub) << (e - 5);
+    return lower + ((((uint64_t) 1) << (e - 5)) - 1);
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(const double percentile) const
+{
+    if(m_count == 0)
+	return 0;
+
+    //rank of the value, counted from 1
+    uint64_t rank = (uint64_t) (percentile / 100 * m_count + 0.5);
+    if(rank < 1)
+	rank = 1;
+    if(rank > m_count)
+	rank = m_count;
+
+    uint64_t seen = 0;
+    for(int b = 0; b < NR_BUCKETS; ++b)
+    {
+	seen += m_counts[b];
+	if(seen >= rank)
+	{
+	    const uint64_t value = BucketUpperBound(b);
+	    return value < m_max ? value : m_max;
+	}
+    }
+    return m_max;
+}
+
+TickProfiler::TickProfiler(void)
+{
+    m_nrTicks    = 0;
+    m_dumpFile   = NULL;
+    m_dumpEvery  = 0;
+    m_dumpJSON   = false;
+    m_dumpHeader = true;
+}
+
+const char* TickProfiler::GetPhaseName(const TickPhase phase)
+{
+    static const char *names[NR_TICK_PHASES] =
+	{"oct_scan", "collision_check", "repulsive_field", "attractive_field", "step_clamp", "apply_move", "tick"};
+    return names[phase];
+}
+
+void TickProfiler::Reset(void)
+{
+    for(int p = 0; p < NR_TICK_PHASES; ++p)
+	m_phases[p].Reset();
+    m_nrTicks = 0;
+}
+
+void TickProfiler::SetPeriodicDump(FILE *out, const int everyTicks, const bool json)
+{
+    m_dumpFile   = out;
+    m_dumpEvery  = out ? everyTicks : 0;
+    m_dumpJSON   = json;
+    m_dumpHeader = true;
+}
+
+void TickProfiler::Dump(void)
+{
+    if(m_dumpFile == NULL)
+	return;
+
+    if(m_dumpJSON)
+	WriteJSON(m_dumpFile);
+    else
+	WriteCSV(m_dumpFile, m_dumpHeader);
+    m_dumpHeader = false;
+    fflush(m_dumpFile);
+}
+
+void TickProfiler::WriteCSV(FILE *out, const bool header) const
+{
+    const double ns = 1 / CyclesPerNanosecond();
+
+    if(header)
+	fprintf(out, "tick,phase,count,minNs,meanNs,p50Ns,p90Ns,p99Ns,p999Ns,maxNs\n");
+    for(int p = 0; p < NR_TICK_PHASES; ++p)
+    {
+	const LatencyHistogram &h = m_phases[p];
+	fprintf(out, "%d,%s,%llu,%.0f,%.1f,%.0f,%.0f,%.0f,%.0f,%.0f\n", m_nrTicks, GetPhaseName((TickPhase) p),
+		(unsigned long long) h.GetCount(), h.GetMin() * ns, h.GetMean() * ns,
+		h.GetValueAtPercentile(50) * ns, h.GetValueAtPercentile(90) * ns,
+		h.GetValueAtPercentile(99) * ns, h.GetValueAtPercentile(99.9) * ns, h.GetMax() * ns);
+    }
+}
+
+void TickProfiler::WriteJSON(FILE *out) const
+{
+    const double ns = 1 / CyclesPerNanosecond();
+
+    fprintf(out, "{\"tick\": %d, \"phases\": {", m_nrTicks);
+    for(int p = 0; p < NR_TICK_PHASES; ++p)
+    {
+	const LatencyHistogram &h = m_phases[p];
+	fprintf(out, "%s\"%s\": {\"count\": %llu, \"minNs\": %.0f, \"meanNs\": %.1f, \"p50Ns\": %.0f, "
+		"\"p90Ns\": %.0f, \"p99Ns\": %.0f, \"p999Ns\": %.0f, \"maxNs\": %.0f}",
+		p > 0 ? ", " : "", GetPhaseName((TickPhase) p), (unsigned long long) h.GetCount(),
+		h.GetMin() * ns, h.GetMean() * ns, h.GetValueAtPercentile(50) * ns, h.GetValueAtPercentile(90) * ns,
+		h.GetValueAtPercentile(99) * ns, h.GetValueAtPercentile(99.9) * ns, h.GetMax() * ns);
+    }
+    fprintf(out, "}}\n");
+}
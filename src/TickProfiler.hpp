@@ -0,0 +1,239 @@
+/**
+ *@file TickProfiler.hpp
+ *@brief Per-phase latency of the planner ticks, from the cycle counter, in
+ *       HDR-style (log-linear) histograms
+ *
+ * The timers are only compiled in when COCHLEAMP_ENABLE_PROFILING is defined
+ * (cmake -DCOCHLEAMP_ENABLE_PROFILING=ON); otherwise PROFILE_PHASE and
+ * PROFILE_END_TICK expand to nothing and ManipPlanner has no profiler, so the
+ * ticks pay nothing.
+ */
+
+#ifndef TICK_PROFILER_HPP_
+#define TICK_PROFILER_HPP_
+
+#include <cstdio>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define TICK_PROFILER_RDTSC
+#else
+#include <chrono>
+#endif
+
+/**
+ *@brief Cycle counter (time stamp counter on x86, nanoseconds elsewhere)
+ */
+inline uint64_t ReadCycleCounter(void)
+{
+#ifdef TICK_PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ *@brief Counter ticks per nanosecond (measured once, on the first call)
+ */
+double CyclesPerNanosecond(void);
+
+/**
+ * Counts of values in buckets of constant relative width: values below 64
+ * have a bucket each, and every power of two above is split into 32 buckets,
+ * so any value is known within 1/32 (about 3%) from 1 to 2^64 in a fixed
+ * array. Recording is a few instructions and never allocates.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(void);
+
+    void Record(const uint64_t value)
+    {
+	m_counts[BucketOf(value)]++;
+	m_count++;
+	m_sum += value;
+	if(value < m_min)
+	    m_min = value;
+	if(value > m_max)
+	    m_max = value;
+    }
+
+    void Reset(void);
+
+    /**
+     *@brief Adds the counts of other (e.g. of another run) to this histogram
+     */
+    void Add(const LatencyHistogram &other);
+
+    uint64_t GetCount(void) const
+    {
+	return m_count;
+    }
+
+    uint64_t GetMin(void) const
+    {
+	return m_count ? m_min : 0;
+    }
+
+    uint64_t GetMax(void) const
+    {
+	return m_max;
+    }
+
+    double GetMean(void) const
+    {
+	return m_count ? (double) m_sum / m_count : 0;
+    }
+
+    /**
+     *@brief Smallest value that percentile percent of the values do not exceed
+     *       (up to the bucket width; the upper end of its bucket, capped at the max)
+     */
+    uint64_t GetValueAtPercentile(const double percentile) const;
+
+    static const int NR_LINEAR   = 64;
+    static const int SUB_BUCKETS = 32;
+    static const int NR_BUCKETS  = NR_LINEAR + (64 - 6) * SUB_BUCKETS;
+
+protected:
+    static int BucketOf(const uint64_t value)
+    {
+	if(value < (uint64_t) NR_LINEAR)
+	    return (int) value;
+#ifdef __GNUC__
+	const int e = 63 - __builtin_clzll(value);
+#else
+	int e = 6;
+	while(value >> (e + 1))
+	    ++e;
+#endif
+	return NR_LINEAR + (e - 6) * SUB_BUCKETS + (int) ((value >> (e - 5)) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t BucketUpperBound(const int bucket);
+
+    uint64_t m_counts[NR_BUCKETS];
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+/**
+ * Phases of a tick: the first five are timed inside ManipPlanner::ConfigurationMove,
+ * TICK_PHASE_APPLY_MOVE (ManipSimulator::ApplyMove and its FK) by the caller, and
+ * TICK_PHASE_TICK is the whole of ConfigurationMove
+ */
+enum TickPhase
+{
+    TICK_PHASE_OCT_SCAN,
+    TICK_PHASE_COLLISION_CHECK,
+    TICK_PHASE_REPULSIVE_FIELD,
+    TICK_PHASE_ATTRACTIVE_FIELD,
+    TICK_PHASE_STEP_CLAMP,
+    TICK_PHASE_APPLY_MOVE,
+    TICK_PHASE_TICK,
+    NR_TICK_PHASES
+};
+
+class TickProfiler
+{
+public:
+    TickProfiler(void);
+
+    void Record(const TickPhase phase, const uint64_t cycles)
+    {
+	m_phases[phase].Record(cycles);
+    }
+
+    const LatencyHistogram& GetHistogram(const TickPhase phase) const
+    {
+	return m_phases[phase];
+    }
+
+    static const char* GetPhaseName(const TickPhase phase);
+
+    int GetNrTicks(void) const
+    {
+	return m_nrTicks;
+    }
+
+    void Reset(void);
+
+    /**
+     *@brief Writes the histograms every everyTicks ticks (0: never) to out, as CSV
+     *       rows (with a header line first) or as one JSON object per line; the
+     *       histograms are cumulative from the start of the run
+     */
+    void SetPeriodicDump(FILE *out, const int everyTicks, const bool json);
+
+    /**
+     *@brief Marks the end of a tick (after the caller has applied the move) and
+     *       writes the periodic dump when it is due
+     */
+    void EndTick(void)
+    {
+	m_nrTicks++;
+	if(m_dumpEvery > 0 && m_nrTicks % m_dumpEvery == 0)
+	    Dump();
+    }
+
+    /**
+     *@brief Writes the histograms now to the periodic dump file (if any)
+     */
+    void Dump(void);
+
+    /**
+     *@brief Count, min, mean, percentiles and max of every phase, in nanoseconds
+     */
+    void WriteCSV(FILE *out, const bool header) const;
+    void WriteJSON(FILE *out) const;
+
+protected:
+    LatencyHistogram m_phases[NR_TICK_PHASES];
+    int              m_nrTicks;
+    FILE            *m_dumpFile;
+    int              m_dumpEvery;
+    bool             m_dumpJSON;
+    bool             m_dumpHeader;
+};
+
+/**
+ * Times the rest of the enclosing scope into a phase of a profiler
+ */
+class TickPhaseTimer
+{
+public:
+    TickPhaseTimer(TickProfiler *profiler, const TickPhase phase)
+    {
+	m_profiler = profiler;
+	m_phase    = phase;
+	m_start    = ReadCycleCounter();
+    }
+
+    ~TickPhaseTimer(void)
+    {
+	m_profiler->Record(m_phase, ReadCycleCounter() - m_start);
+    }
+
+protected:
+    TickProfiler *m_profiler;
+    TickPhase     m_phase;
+    uint64_t      m_start;
+};
+
+#ifdef COCHLEAMP_ENABLE_PROFILING
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_PHASE(profiler, phase) TickPhaseTimer PROFILE_CONCAT(phaseTimer, __LINE__)(profiler, phase)
+#define PROFILE_END_TICK(profiler) (profiler)->EndTick()
+#else
+#define PROFILE_PHASE(profiler, phase)
+#define PROFILE_END_TICK(profiler)
+#endif
+
+#endif
@@ -0,0 +1,284 @@
+#include "TrajectoryLog.hpp"
+#include <cstring>
+
+//longest varint (64 bits, 7 per byte)
+static const int MAX_VARINT_BYTES = 10;
+
+static void PutVarint(std::vector<unsigned char> &buffer, uint64_t v)
+{
+    while(v >= 0x80)
+    {
+	buffer.push_back((unsigned char) (v | 0x80));
+	v >>= 7;
+    }
+    buffer.push_back((unsigned char) v);
+}
+
+static bool GetVarint(const unsigned char *&p, const unsigned char *end, uint64_t &v)
+{
+    v = 0;
+    for(int shift = 0; p < end && shift < 7 * MAX_VARINT_BYTES; shift += 7)
+    {
+	const unsigned char b = *p++;
+	v |= ((uint64_t) (b & 0x7f)) << shift;
+	if((b & 0x80) == 0)
+	    return true;
+    }
+    return false;
+}
+
+//small negative and positive differences both become small varints
+static uint64_t ZigZag(const int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t UnZigZag(const uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static uint64_t Bits(const double x)
+{
+    uint64_t b;
+    memcpy(&b, &x, sizeof(b));
+    return b;
+}
+
+static double FromBits(const uint64_t b)
+{
+    double x;
+    memcpy(&x, &b, sizeof(x));
+    return x;
+}
+
+TrajectoryWriter::TrajectoryWriter(void)
+{
+    m_file = NULL;
+}
+
+TrajectoryWriter::~TrajectoryWriter(void)
+{
+    Close();
+}
+
+bool TrajectoryWriter::Open(const char fname[], const ManipSimulator &simulator)
+{
+    Close();
+
+    const int n = simulator.GetNrLinks();
+    if(n + 2 > 64)
+    {
+	printf("error: trajectory logs are limited to 62 links\n");
+	return false;
+    }
+
+    m_file = fopen(fname, "wb");
+    if(m_file == NULL)
+    {
+	printf("error: cannot write %s\n", fname);
+	return false;
+    }
+
+    TrajectoryFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAJECTORY_FILE_MAGIC, sizeof(header.magic));
+    header.version     = TRAJECTORY_FILE_VERSION;
+    header.byteOrder   = TRAJECTORY_FILE_BYTEORDER;
+    header.nrLinks     = n;
+    header.nrObstacles = simulator.GetNrObstacles();
+
+    ElectrodeConfiguration config;
+    simulator.GetConfiguration(config);
+
+    m_previous.resize(n + 2);
+    for(int i = 0; i < n; ++i)
+	m_previous[i] = Bits(config.joints[i]);
+    m_previous[n]     = Bits(config.baseX);
+    m_previous[n + 1] = Bits(config.baseY);
+
+    bool ok = fwrite(&header, sizeof(header), 1, m_file) == 1;
+    for(int i = 0; i < n && ok; ++i)
+    {
+	const double length = simulator.GetLinkLength(i);
+	ok = fwrite(&length, sizeof(length), 1, m_file) == 1;
+    }
+    ok = ok &&
+	fwrite(&config.baseX, sizeof(double), 1, m_file) == 1 &&
+	fwrite(&config.baseY, sizeof(double), 1, m_file) == 1 &&
+	(n == 0 || fwrite(&config.joints[0], sizeof(double), n, m_file) == (size_t) n);
+    if(!ok)
+    {
+	printf("error: failed writing %s\n", fname);
+	Close();
+	return false;
+    }
+
+    //a tick with every value changed and a few damaged cells
+    m_buffer.reserve((n + 5) * MAX_VARINT_BYTES + 64 * MAX_VARINT_BYTES);
+    return true;
+}
+
+void TrajectoryWriter::Record(const ManipSimulator &simulator, const int stage, const DamageTracker &damage)
+{
+    if(m_file == NULL)
+	return;
+
+    const int n = m_previous.size() - 2;
+
+    m_buffer.clear();
+    PutVarint(m_buffer, stage);
+
+    uint64_t current[64];
+    uint64_t changed = 0;
+    for(int i = 0; i < n; ++i)
+	current[i] = Bits(simulator.GetLinkTheta(i));
+    current[n]     = Bits(simulator.GetLinkStartX(0));
+    current[n + 1] = Bits(simulator.GetLinkStartY(0));
+    for(int i = 0; i < n + 2; ++i)
+	if(current[i] != m_previous[i])
+	    changed |= ((uint64_t) 1) << i;
+
+    PutVarint(m_buffer, changed);
+    for(int i = 0; i < n + 2; ++i)
+	if(current[i] != m_previous[i])
+	{
+	    PutVarint(m_buffer, ZigZag((int64_t) (current[i] - m_previous[i])));
+	    m_previous[i] = current[i];
+	}
+
+    const int  nrNew = damage.GetNrNewlyDamaged();
+    const int *cells = damage.GetNewlyDamaged();
+    PutVarint(m_buffer, nrNew);
+    for(int k = 0; k < nrNew; ++k)
+	PutVarint(m_buffer, ZigZag((int64_t) cells[k] - (k > 0 ? cells[k - 1] : 0)));
+
+    fwrite(&m_buffer[0], 1, m_buffer.size(), m_file);
+}
+
+void TrajectoryWriter::Close(void)
+{
+    if(m_file)
+	fclose(m_file);
+    m_file = NULL;
+}
+
+TrajectoryReader::TrajectoryReader(void)
+{
+    m_begin       = NULL;
+    m_end         = NULL;
+    m_next        = NULL;
+    m_tick        = 0;
+    m_nrObstacles = 0;
+}
+
+bool TrajectoryReader::Open(const char fname[])
+{
+    if(!m_file.Open(fname))
+    {
+	printf("error: cannot read %s\n", fname);
+	return false;
+    }
+
+    TrajectoryFileHeader header;
+    const unsigned char *data = (const unsigned char *) m_file.GetData();
+    const uint64_t       size = m_file.GetSize();
+    if(size < sizeof(header))
+    {
+	printf("error: %s is not a trajectory log\n", fname);
+	return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    const uint64_t n = header.nrLinks;
+    if(memcmp(header.magic, TRAJECTORY_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != TRAJECTORY_FILE_VERSION || header.byteOrder != TRAJECTORY_FILE_BYTEORDER ||
+       n + 2 > 64 || size < sizeof(header) + (2 * n + 2) * sizeof(double))
+    {
+	printf("error: %s is not a trajectory log (or was written by another version or machine)\n", fname);
+	return false;
+    }
+
+    const unsigned char *p = data + sizeof(header);
+    m_lengths.resize(n);
+    m_initial.joints.resize(n);
+    if(n > 0)
+	memcpy(&m_lengths[0], p, n * sizeof(double));
+    p += n * sizeof(double);
+    memcpy(&m_initial.baseX, p, sizeof(double));
+    memcpy(&m_initial.baseY, p + sizeof(double), sizeof(double));
+    p += 2 * sizeof(double);
+    if(n > 0)
+	memcpy(&m_initial.joints[0], p, n * sizeof(double));
+    p += n * sizeof(double);
+
+    m_nrObstacles = header.nrObstacles;
+    m_begin       = p;
+    m_end         = data + size;
+    Rewind();
+
+    return true;
+}
+
+void TrajectoryReader::Rewind(void)
+{
+    const int n = m_lengths.size();
+
+    m_next = m_begin;
+    m_tick = 0;
+    m_current.resize(n + 2);
+    for(int i = 0; i < n; ++i)
+	m_current[i] = Bits(m_initial.joints[i]);
+    m_current[n]     = Bits(m_initial.baseX);
+    m_current[n + 1] = Bits(m_initial.baseY);
+}
+
+bool TrajectoryReader::Next(TrajectoryFrame &frame)
+{
+    const int n = m_lengths.size();
+
+    //decode into locals first, so a record cut short leaves the reader at the
+    //last complete tick
+    const unsigned char *p = m_next;
+    uint64_t stage, changed, nrNew, v;
+    if(!GetVarint(p, m_end, stage) || !GetVarint(p, m_end, changed))
+	return false;
+
+    uint64_t current[64];
+    for(int i = 0; i < n + 2; ++i)
+    {
+	current[i] = m_current[i];
+	if(((changed >> i) & 1) == 0)
+	    continue;
+	if(!GetVarint(p, m_end, v))
+	    return false;
+	current[i] += (uint64_t) UnZigZag(v);
+    }
+
+    if(!GetVarint(p, m_end, nrNew) || nrNew > (uint64_t) (m_end - p))
+	return false;
+    frame.newlyDamaged.resize(nrNew);
+    int cell = 0;
+    for(uint64_t k = 0; k < nrNew; ++k)
+    {
+	if(!GetVarint(p, m_end, v))
+	    return false;
+	cell += (int) UnZigZag(v);
+	frame.newlyDamaged[k] = cell;
+    }
+
+    m_next = p;
+    m_tick++;
+    for(int i = 0; i < n + 2; ++i)
+	m_current[i] = current[i];
+
+    frame.tick  = m_tick;
+    frame.stage = (int) stage;
+    frame.config.joints.resize(n);
+    for(int i = 0; i < n; ++i)
+	frame.config.joints[i] = FromBits(m_current[i]);
+    frame.config.baseX = FromBits(m_current[n]);
+    frame.config.baseY = FromBits(m_current[n + 1]);
+
+    return true;
+}
@@ -0,0 +1,158 @@
+/**
+ *@file TrajectoryLog.hpp
+ *@brief Compact binary record of an insertion, tick by tick, that can be
+ *       replayed (drawn or analyzed) without running the planner again
+ *
+ * Layout (native byte order, checked through a byte-order marker):
+ *   TrajectoryFileHeader
+ *   lengths[nrLinks]                        doubles
+ *   baseX, baseY, joints[nrLinks]           doubles, configuration before the first tick
+ *   one record per tick:
+ *     stage                                 varint
+ *     changed                               varint, bit i for joint i, bits nrLinks and
+ *                                           nrLinks + 1 for the base x and y
+ *     delta[number of changed bits]         zigzag varints, difference of the 64-bit
+ *                                           patterns of the new and previous values
+ *     nrNewlyDamaged                        varint
+ *     cells[nrNewlyDamaged]                 zigzag varints, each relative to the previous
+ *                                           cell of the tick (the first to 0)
+ *
+ * The deltas are taken on the bit patterns, so the replayed configurations are
+ * exactly the recorded ones. A joint that does not move costs nothing, so a
+ * tick usually takes 10 to 30 bytes.
+ */
+
+#ifndef TRAJECTORY_LOG_HPP_
+#define TRAJECTORY_LOG_HPP_
+
+#include "DamageTracker.hpp"
+#include "ManipSimulator.hpp"
+#include "ObstacleFile.hpp"
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+#define TRAJECTORY_FILE_MAGIC     "CMPTRAJ"
+#define TRAJECTORY_FILE_VERSION   1
+#define TRAJECTORY_FILE_BYTEORDER 0x01020304u
+
+struct TrajectoryFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t nrLinks;
+    uint32_t nrObstacles;
+};
+
+/**
+ * One replayed tick: the configuration after the move and what it scraped
+ */
+struct TrajectoryFrame
+{
+    int                    tick;
+    int                    stage;
+    ElectrodeConfiguration config;
+    std::vector<int>       newlyDamaged;
+};
+
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter(void);
+
+    ~TrajectoryWriter(void);
+
+    /**
+     *@brief Creates the log and writes the header, the links and the current
+     *       configuration of the simulator (the links must be set up)
+     */
+    bool Open(const char fname[], const ManipSimulator &simulator);
+
+    /**
+     *@brief Appends one tick: the configuration of the simulator after the
+     *       move, the planner stage and the newly damaged cells. Buffers are
+     *       reused, so recording does not allocate after the first ticks.
+     */
+    void Record(const ManipSimulator &simulator, const int stage, const DamageTracker &damage);
+
+    void Close(void);
+
+    bool IsOpen(void) const
+    {
+	return m_file != NULL;
+    }
+
+protected:
+    FILE                      *m_file;
+
+    //bit patterns of the last recorded joints, base x and base y
+    std::vector<uint64_t>      m_previous;
+    std::vector<unsigned char> m_buffer;
+
+private:
+    TrajectoryWriter(const TrajectoryWriter &);
+    TrajectoryWriter& operator=(const TrajectoryWriter &);
+};
+
+class TrajectoryReader
+{
+public:
+    TrajectoryReader(void);
+
+    /**
+     *@brief Maps the log and checks its header
+     *
+     *@return false if the file cannot be read or is not a trajectory log
+     */
+    bool Open(const char fname[]);
+
+    int GetNrLinks(void) const
+    {
+	return m_lengths.size();
+    }
+
+    int GetNrObstacles(void) const
+    {
+	return m_nrObstacles;
+    }
+
+    const std::vector<double>& GetLinkLengths(void) const
+    {
+	return m_lengths;
+    }
+
+    /**
+     *@brief Configuration before the first tick
+     */
+    const ElectrodeConfiguration& GetInitialConfiguration(void) const
+    {
+	return m_initial;
+    }
+
+    /**
+     *@brief Decodes the next tick into frame (whose buffers are reused)
+     *
+     *@return false at the end of the log; a record cut short (e.g. by a crash
+     *        while recording) counts as the end
+     */
+    bool Next(TrajectoryFrame &frame);
+
+    /**
+     *@brief Goes back to the configuration before the first tick
+     */
+    void Rewind(void);
+
+protected:
+    MappedFile             m_file;
+    const unsigned char   *m_begin;
+    const unsigned char   *m_end;
+    const unsigned char   *m_next;
+    int                    m_tick;
+    int                    m_nrObstacles;
+    std::vector<double>    m_lengths;
+    ElectrodeConfiguration m_initial;
+    std::vector<uint64_t>  m_current;
+};
+
+#endif
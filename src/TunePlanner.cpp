@@ -0,0 +1,45 @@
+/**
+ *@file TunePlanner.cpp
+ *@brief Searches the planner gains that minimize the damage over a set of
+ *       anatomies and prints the best ones
+ */
+
+#include "GainTuner.hpp"
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+	printf("missing arguments\n");		
+	printf("  TunePlanner <tuning file> [log csv] [nrThreads] \n");
+	return 0;		
+    }
+
+    TuningSpec spec;
+    if(!LoadTuningSpec(argv[1], spec))
+	return 1;
+
+    FILE *log = NULL;
+    if(argc > 2 && (log = fopen(argv[2], "w")) == NULL)
+    {
+	printf("error: cannot write %s\n", argv[2]);
+	return 1;
+    }
+    
+    ThreadPool       pool(argc > 3 ? atoi(argv[3]) : 0);
+    TuningEvaluation best;
+    const bool       ok = TuneGains(spec, pool, best, log);
+    if(log)
+	fclose(log);
+    if(!ok)
+	return 1;
+    
+    printf("BEST COST: %g (CELLS DAMAGED: %d, TICKS: %d, COMPLETED: %d of %d)\n", best.cost,
+	   best.totalCellsDamaged, best.ticks, best.nrCompleted, (int) spec.anatomies.size());
+    printf("alpha %.17g\ngamma %.17g\nQ %.17g\nbeta %.17g\n", best.params.alpha, best.params.gamma, best.params.Q, best.params.beta);
+    printf("localMinimumBetaFactor %.17g\nlocalMinimumAlphaFactor %.17g\n",
+	   best.params.localMinimumBetaFactor, best.params.localMinimumAlphaFactor);
+    printf("MAX_OCT_DEPTH %.17g\nANGLE_BANDWIDTH %.17g\n", best.params.maxOCTDepth, best.params.angleBandwidth);
+    
+    return 0;
+}